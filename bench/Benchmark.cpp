@@ -0,0 +1,163 @@
+#include "Benchmark.h"
+#include "quake/MapParser.h"
+#include "quake/WadFileLoader.h"
+#include "quake/Palette.h"
+#include "quake/Lightmaps.h"
+#include "quake/HeadlessTextureUploader.h"
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <iomanip>
+
+namespace quake
+{
+
+double Benchmark::Result::MBPerSec() const
+{
+	return seconds > 0 ? bytes * iterations / seconds / (1024.0 * 1024.0) : 0;
+}
+
+double Benchmark::Result::ItemsPerSec() const
+{
+	return seconds > 0 ? items * iterations / seconds : 0;
+}
+
+std::vector<Benchmark::Result> Benchmark::Run(const Params& params, TextureUploader* uploader)
+{
+	std::vector<Result> results;
+
+	// map tokenizer and parser
+	MapFormat::Type formats[] = { MapFormat::Standard, MapFormat::Quake2, MapFormat::Valve };
+	for (auto format : formats)
+	{
+		auto map_params = params.map;
+		map_params.format = format;
+		const std::string map = SyntheticData::GenerateMap(map_params);
+		const std::string suffix = format == MapFormat::Quake2 ? "/quake2" :
+			(format == MapFormat::Valve ? "/valve" : "/standard");
+
+		results.push_back(Measure("MapTokenizer" + suffix, "tokens", map.size(), params, nullptr, [&]() {
+			MapTokenizer tokenizer(map);
+			uint64_t n = 0;
+			while (tokenizer.NextToken().GetType() != MapToken::Eof) {
+				++n;
+			}
+			return n;
+		}));
+
+		results.push_back(Measure("MapParser::Parse" + suffix, "faces", map.size(), params, nullptr, [&]() {
+			MapParser parser(map);
+			parser.Parse();
+			uint64_t n = 0;
+			for (auto& e : parser.GetAllEntities()) {
+				for (auto& b : e->brushes) {
+					n += b->Faces().size();
+				}
+			}
+			return n;
+		}));
+	}
+
+	// own context so the default registry and atlas are left alone
+	MapContext ctx;
+
+	// wad
+	const auto wad = SyntheticData::GenerateWad(params.wad);
+	Palette palette;
+	HeadlessTextureUploader headless(false);
+	if (!uploader) {
+		uploader = &headless;
+	}
+	// a fresh context each iteration, otherwise every load after the first
+	// only shares the textures already registered
+	std::unique_ptr<MapContext> wad_ctx;
+	results.push_back(Measure("WadFileLoader::Load", "textures", wad.size(), params, [&]() {
+		wad_ctx.reset();
+		wad_ctx = std::make_unique<MapContext>();
+	}, [&]() {
+		WadFileLoader loader(palette, *wad_ctx);
+		loader.Load(*uploader, wad.data(), wad.size());
+		return static_cast<uint64_t>(params.wad.textures);
+	}));
+	wad_ctx.reset();
+
+	// palette, over all wad bytes as indices
+	std::vector<unsigned char> rgb(wad.size() * 3);
+	results.push_back(Measure("Palette::IndexedToRgb", "pixels", wad.size(), params, nullptr, [&]() {
+		palette.IndexedToRgb(wad.data(), wad.size(), rgb.data());
+		return static_cast<uint64_t>(wad.size());
+	}));
+
+	// lightmap packing, quake's surfaces are at most 18x18 luxels
+	std::vector<std::pair<int, int>> sizes(params.lightmap_blocks);
+	std::mt19937 rng(params.map.seed);
+	for (auto& s : sizes) {
+		s.first  = 1 + rng() % 18;
+		s.second = 1 + rng() % 18;
+	}
+	auto& lightmaps = ctx.GetLightmaps();
+	results.push_back(Measure("Lightmaps::AllocBlock", "blocks", 0, params, [&]() {
+		lightmaps.Clear();
+	}, [&]() {
+		int x, y;
+		uint64_t placed = 0;
+		for (auto& s : sizes) {
+			if (lightmaps.AllocBlock(s.first, s.second, &x, &y) >= 0) {
+				++placed;
+			}
+		}
+		return placed;
+	}));
+
+	return results;
+}
+
+std::string Benchmark::Report(const std::vector<Result>& results)
+{
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(2);
+	ss << std::left << std::setw(32) << "benchmark"
+	   << std::right << std::setw(8) << "iters"
+	   << std::setw(14) << "ms/iter"
+	   << std::setw(12) << "MB/s"
+	   << std::setw(16) << "items/s" << "\n";
+	for (auto& r : results)
+	{
+		ss << std::left << std::setw(32) << r.name
+		   << std::right << std::setw(8) << r.iterations
+		   << std::setw(14) << (r.iterations ? r.seconds * 1000 / r.iterations : 0)
+		   << std::setw(12) << r.MBPerSec()
+		   << std::setw(16) << r.ItemsPerSec() << " " << r.item_name << "\n";
+	}
+	return ss.str();
+}
+
+Benchmark::Result Benchmark::Measure(const std::string& name, const std::string& item_name, uint64_t bytes,
+	                                 const Params& params, const std::function<void()>& setup,
+	                                 const std::function<uint64_t()>& run)
+{
+	Result ret;
+	ret.name      = name;
+	ret.item_name = item_name;
+	ret.bytes     = bytes;
+
+	while (ret.iterations < params.min_iterations || ret.seconds < params.min_seconds)
+	{
+		if (setup) {
+			setup();
+		}
+
+		auto begin = std::chrono::steady_clock::now();
+		ret.items = run();
+		auto end = std::chrono::steady_clock::now();
+
+		ret.seconds += std::chrono::duration<double>(end - begin).count();
+		++ret.iterations;
+	}
+
+	return ret;
+}
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "SyntheticData.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+class TextureUploader;
+
+// Times the load path on synthetic data and reports MB/s and items/s.
+class Benchmark
+{
+public:
+	struct Params
+	{
+		SyntheticData::MapParams map;
+		SyntheticData::WadParams wad;
+
+		size_t lightmap_blocks = 8192;
+
+		size_t min_iterations = 3;
+		double min_seconds    = 0.5;
+	};
+
+	struct Result
+	{
+		std::string name;
+		size_t   iterations = 0;
+		double   seconds    = 0;    // total over all iterations
+		uint64_t bytes      = 0;    // per iteration
+		uint64_t items      = 0;    // per iteration
+		std::string item_name;
+
+		double MBPerSec() const;
+		double ItemsPerSec() const;
+	};
+
+public:
+	// without an uploader the textures go to a HeadlessTextureUploader
+	static std::vector<Result> Run(const Params& params, TextureUploader* uploader = nullptr);
+
+	static std::string Report(const std::vector<Result>& results);
+
+private:
+	// setup isn't timed, run returns the processed items
+	static Result Measure(const std::string& name, const std::string& item_name, uint64_t bytes,
+		const Params& params, const std::function<void()>& setup, const std::function<uint64_t()>& run);
+
+}; // Benchmark
+
+}
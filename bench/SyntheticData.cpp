@@ -0,0 +1,222 @@
+#include "SyntheticData.h"
+
+#include <random>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+
+const int WAD_NAME_LEN = 16;
+const int MIP_LEVEL    = 4;
+
+const char* TEXTURES[] = {
+	"city2_1", "city4_6", "wbrick1_5", "metal1_2", "tech08_2", "sky1", "*water0", "clip"
+};
+
+struct Vec
+{
+	double x, y, z;
+
+	Vec operator + (const Vec& v) const { return { x + v.x, y + v.y, z + v.z }; }
+	Vec operator - (const Vec& v) const { return { x - v.x, y - v.y, z - v.z }; }
+	Vec operator * (double s) const { return { x * s, y * s, z * s }; }
+	Vec Cross(const Vec& v) const { return { y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x }; }
+};
+
+void WriteVec(std::ostream& os, const Vec& v)
+{
+	os << "( " << v.x << " " << v.y << " " << v.z << " )";
+}
+
+// quake's three points give normal = (p0 - p1) x (p2 - p1), pointing out of the brush
+void WriteFace(std::ostream& os, quake::MapFormat::Type format, const Vec& point, const Vec& normal,
+	           const char* tex, std::mt19937& rng)
+{
+	Vec u = fabs(normal.z) < 0.9 ? Vec{ 0, 0, 1 }.Cross(normal) : Vec{ 1, 0, 0 }.Cross(normal);
+	const double len = sqrt(u.x * u.x + u.y * u.y + u.z * u.z);
+	u = u * (64.0 / len);
+	const Vec v = normal.Cross(u);
+
+	WriteVec(os, point + u);
+	os << " ";
+	WriteVec(os, point);
+	os << " ";
+	WriteVec(os, point + v);
+	os << " " << tex;
+
+	const int xoff = static_cast<int>(rng() % 64), yoff = static_cast<int>(rng() % 64);
+	if (format == quake::MapFormat::Valve) {
+		os << " [ 1 0 0 " << xoff << " ] [ 0 -1 0 " << yoff << " ] 0 1 1";
+	} else {
+		os << " " << xoff << " " << yoff << " 0 1 1";
+	}
+	if (format == quake::MapFormat::Quake2) {
+		os << " 0 0 0";
+	}
+	os << "\n";
+}
+
+void WriteBrush(std::ostream& os, const quake::SyntheticData::MapParams& params, std::mt19937& rng)
+{
+	const Vec center = {
+		static_cast<double>(static_cast<int>(rng() % 8192) - 4096),
+		static_cast<double>(static_cast<int>(rng() % 8192) - 4096),
+		static_cast<double>(static_cast<int>(rng() % 2048) - 1024)
+	};
+	const double radius = 16 + rng() % 128;
+	const double height = 16 + rng() % 128;
+
+	const char* tex = TEXTURES[rng() % (sizeof(TEXTURES) / sizeof(TEXTURES[0]))];
+
+	os << "{\n";
+
+	const size_t sides = params.faces_per_brush < 5 ? 3 : params.faces_per_brush - 2;
+	for (size_t i = 0; i < sides; ++i)
+	{
+		const double a = 2 * 3.14159265358979 * (i + 0.5) / sides;
+		const Vec normal = { cos(a), sin(a), 0 };
+		WriteFace(os, params.format, center + normal * radius, normal, tex, rng);
+	}
+	WriteFace(os, params.format, center + Vec{ 0, 0, height }, Vec{ 0, 0, 1 }, tex, rng);
+	WriteFace(os, params.format, center - Vec{ 0, 0, height }, Vec{ 0, 0, -1 }, tex, rng);
+
+	os << "}\n";
+}
+
+void WriteAttribute(std::ostream& os, const std::string& name, const std::string& val)
+{
+	os << "\"" << name << "\" \"" << val << "\"\n";
+}
+
+template <typename T>
+void Append(std::vector<unsigned char>& buf, const T& val)
+{
+	const size_t pos = buf.size();
+	buf.resize(pos + sizeof(T));
+	memcpy(&buf[pos], &val, sizeof(T));
+}
+
+}
+
+namespace quake
+{
+namespace SyntheticData
+{
+
+std::string GenerateMap(const MapParams& params)
+{
+	std::mt19937 rng(params.seed);
+
+	std::stringstream ss;
+	ss << std::setprecision(8);
+
+	for (size_t i = 0; i < params.entities; ++i)
+	{
+		ss << "// entity " << i << "\n{\n";
+		if (i == 0)
+		{
+			WriteAttribute(ss, "classname", "worldspawn");
+			WriteAttribute(ss, "wad", "gfx/base.wad");
+			if (params.format == MapFormat::Valve) {
+				WriteAttribute(ss, "mapversion", "220");
+			}
+		}
+		else if (i % 2 == 1)
+		{
+			WriteAttribute(ss, "classname", "light");
+			std::stringstream origin;
+			origin << static_cast<int>(rng() % 8192) - 4096 << " "
+				   << static_cast<int>(rng() % 8192) - 4096 << " "
+				   << static_cast<int>(rng() % 2048) - 1024;
+			WriteAttribute(ss, "origin", origin.str());
+			WriteAttribute(ss, "light", std::to_string(100 + rng() % 300));
+			ss << "}\n";
+			continue;
+		}
+		else
+		{
+			WriteAttribute(ss, "classname", "func_door");
+			WriteAttribute(ss, "spawnflags", std::to_string(rng() % 512));
+			WriteAttribute(ss, "targetname", "t" + std::to_string(i));
+		}
+
+		for (size_t j = 0; j < params.brushes_per_entity; ++j) {
+			WriteBrush(ss, params, rng);
+		}
+		ss << "}\n";
+	}
+
+	return ss.str();
+}
+
+std::vector<unsigned char> GenerateWad(const WadParams& params)
+{
+	std::mt19937 rng(params.seed);
+
+	const uint32_t min_blocks = std::max<uint32_t>(1, params.min_size / 16);
+	const uint32_t max_blocks = std::max(min_blocks, params.max_size / 16);
+
+	std::vector<unsigned char> buf;
+	buf.resize(12);
+	memcpy(&buf[0], "WAD2", 4);
+
+	struct Entry
+	{
+		int32_t offset, dsize, size;
+		char    type, cmprs;
+		int16_t dummy;
+		char    name[WAD_NAME_LEN];
+	};
+	std::vector<Entry> entries;
+
+	for (size_t i = 0; i < params.textures; ++i)
+	{
+		const uint32_t w = 16 * (min_blocks + rng() % (max_blocks - min_blocks + 1));
+		const uint32_t h = 16 * (min_blocks + rng() % (max_blocks - min_blocks + 1));
+
+		Entry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.offset = static_cast<int32_t>(buf.size());
+		entry.type = 'D';
+		snprintf(entry.name, WAD_NAME_LEN, "tex%04u", static_cast<unsigned int>(i));
+
+		char name[WAD_NAME_LEN];
+		memcpy(name, entry.name, WAD_NAME_LEN);
+		buf.insert(buf.end(), name, name + WAD_NAME_LEN);
+		Append(buf, w);
+		Append(buf, h);
+
+		uint32_t offset = WAD_NAME_LEN + 4 * 2 + 4 * MIP_LEVEL;
+		for (int m = 0; m < MIP_LEVEL; ++m) {
+			Append(buf, offset);
+			offset += (w >> m) * (h >> m);
+		}
+		for (int m = 0; m < MIP_LEVEL; ++m) {
+			for (uint32_t p = 0, n = (w >> m) * (h >> m); p < n; ++p) {
+				buf.push_back(static_cast<unsigned char>(rng() & 0xff));
+			}
+		}
+
+		entry.dsize = entry.size = static_cast<int32_t>(buf.size()) - entry.offset;
+		entries.push_back(entry);
+	}
+
+	const int32_t numentries = static_cast<int32_t>(entries.size());
+	const int32_t diroffset  = static_cast<int32_t>(buf.size());
+	memcpy(&buf[4], &numentries, 4);
+	memcpy(&buf[8], &diroffset, 4);
+	for (auto& e : entries) {
+		Append(buf, e);
+	}
+
+	return buf;
+}
+
+}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "quake/MapParser.h"
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+// Deterministic generators for benchmarks and regression checks, the same
+// params and seed always give the same bytes.
+namespace SyntheticData
+{
+
+struct MapParams
+{
+	size_t entities           = 64;   // including worldspawn
+	size_t brushes_per_entity = 32;   // for worldspawn and brush entities
+	size_t faces_per_brush    = 6;    // >= 5, side faces of a prism plus top and bottom
+
+	MapFormat::Type format = MapFormat::Standard;  // Standard, Valve or Quake2
+
+	uint32_t seed = 1;
+};
+
+std::string GenerateMap(const MapParams& params);
+
+struct WadParams
+{
+	size_t   textures = 64;
+	uint32_t min_size = 16;           // multiples of 16, like quake's miptex
+	uint32_t max_size = 256;
+
+	uint32_t seed = 1;
+};
+
+std::vector<unsigned char> GenerateWad(const WadParams& params);
+
+}
+
+}
@@ -0,0 +1,22 @@
+#include "Benchmark.h"
+
+#include <iostream>
+
+#include <stdlib.h>
+
+// quake-bench [scale], scale multiplies the synthetic map and wad sizes
+int main(int argc, char* argv[])
+{
+	quake::Benchmark::Params params;
+	if (argc > 1)
+	{
+		const int scale = atoi(argv[1]);
+		if (scale > 0) {
+			params.map.entities *= scale;
+			params.wad.textures *= scale;
+		}
+	}
+
+	std::cout << quake::Benchmark::Report(quake::Benchmark::Run(params));
+	return 0;
+}
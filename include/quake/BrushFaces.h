@@ -0,0 +1,40 @@
+#pragma once
+
+#include "quake/SurfaceFlags.h"
+
+#include <SM_Vector.h>
+#include <polymesh3/Polytope.h>
+
+#include <vector>
+
+namespace quake
+{
+
+struct BrushFace
+{
+	const pm3::Polytope::Face* face = nullptr;
+	// into brush.Faces(), and so into the brush's surfaces and tex axes
+	uint32_t    index = 0;
+	FaceSurface surface;
+
+	// outward plane, normal.Dot(p) == dist on the face
+	sm::vec3 normal;
+	float    dist = 0;
+
+	// counter-clockwise around the outward normal
+	std::vector<sm::vec3> vertices;
+
+}; // BrushFace
+
+// Face polygons of a brush, rebuilt from its points and face planes.
+// Faces without area are skipped. surfaces are the brush's, one per face,
+// see MapEntity::GetSurfaces(), without them they come from the texture names
+void BuildBrushFaces(const pm3::Polytope& brush, std::vector<BrushFace>& faces,
+	const FaceSurface* surfaces = nullptr);
+
+// quake's texture projection, axis are in parser space and already
+// rotated and scaled: u = s_axis.Dot(p) + offset.x, v = t_axis.Dot(p) + offset.y
+void CalcTextureAxis(const sm::vec3& normal, float angle, const sm::vec2& scale,
+	sm::vec3& s_axis, sm::vec3& t_axis);
+
+}
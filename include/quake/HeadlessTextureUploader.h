@@ -0,0 +1,45 @@
+#pragma once
+
+#include "quake/TextureUploader.h"
+
+#include <vector>
+
+namespace quake
+{
+
+// Stand-in for a gpu device: keeps the pixels in host memory and hands
+// out null textures, for build machines without a gpu. What was uploaded
+// is in GetTextures() and the base's records, TextureManager keeps the
+// sizes and bytes of the textures registered with it by itself.
+class HeadlessTextureUploader : public TextureUploader
+{
+public:
+	struct HostTexture
+	{
+		size_t width;
+		size_t height;
+		ur::TextureFormat format;
+		std::vector<unsigned char> pixels;
+	};
+
+public:
+	HeadlessTextureUploader(bool keep_pixels = true);
+
+	// textures in upload order
+	auto& GetTextures() const { return m_textures; }
+
+	void Clear();
+
+protected:
+	virtual ur::TexturePtr OnCreateTexture(size_t width, size_t height,
+		ur::TextureFormat format, const void* pixels, size_t size) override;
+
+private:
+	bool m_keep_pixels;
+
+	std::mutex m_mtx;
+	std::vector<HostTexture> m_textures;
+
+}; // HeadlessTextureUploader
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "quake/BrushFaces.h"
+
+#include <vector>
+
+namespace quake
+{
+
+// Drops or trims brush faces pressed against a coplanar, opposite facing
+// face of another solid brush, and of two coplanar faces facing the same
+// way keeps the one of the lower brush index. Only brushes of the same
+// group (usually the entity index) hide each other, and only brushes with
+// all faces drawn and opaque hide anything, so no liquid, translucent, '{'
+// alpha tested or partly invisible brush.
+class HiddenFaceRemoval
+{
+public:
+	struct Stats
+	{
+		size_t faces_in   = 0;
+		size_t faces_out  = 0;
+		size_t removed    = 0;  // fully covered faces
+		size_t trimmed    = 0;  // partially covered faces, split into visible pieces
+	};
+
+public:
+	// faces[i] are the faces of brush i, replaced by the visible parts
+	static Stats Run(const std::vector<int>& groups,
+		std::vector<std::vector<BrushFace>>& faces);
+
+}; // HiddenFaceRemoval
+
+}
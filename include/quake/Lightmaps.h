@@ -1,46 +1,109 @@
 #pragma once
 
-#include <cu/cu_macro.h>
+#include "quake/Profiler.h"
+
 #include <unirender/typedef.h>
 
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 namespace ur { class Device; }
 
 namespace quake
 {
 
+class TextureUploader;
+
 class Lightmaps
 {
 public:
+	// how a luxel is stored and uploaded. quake 1 light is monochrome and
+	// fits R8, colored light needs RGB8, RGB9E5 keeps overbright values
+	enum class Format
+	{
+		// uploaded as a one channel RED texture without swizzle, so g and b
+		// sample 0. shaders have to spread the light with texture(lm, uv).rrr
+		// instead of .rgb, the default RGBA8 needs no change
+		R8,
+		RGB8,
+		RGBA8,
+		// 9 bit mantissas sharing a 5 bit exponent. only the host pages are
+		// 4 bytes a luxel, they are expanded to RGBA16F for the upload, so on
+		// the gpu it takes 8 bytes a luxel, twice RGBA8
+		RGB9E5,
+	};
+
+public:
+	Lightmaps(Format format = Format::RGBA8);
+
+	// clears the atlas
+	void SetFormat(Format format);
+	Format GetFormat() const { return m_format; }
+
+	int GetBytesPerLuxel() const { return m_bpp; }
+	static int BytesPerLuxel(Format format);
+
+	// pages are created as blocks are allocated into them, pointers from
+	// Query() are only valid until the next AllocBlock(). -1 if the block
+	// fits no page, x and y are then meaningless and callers leave the
+	// surface without a lightmap
 	int AllocBlock(int w, int h, int* x, int* y);
 
+	// the luxel in the atlas format
 	uint8_t* Query(int tex_idx, int x, int y);
+	const uint8_t* Query(int tex_idx, int x, int y) const;
+
+	// luxels as floats, 1 is 255 in the 8 bit formats which clamp above it.
+	// R8 keeps the brightness SurfaceCache lights with
+	void SetLuxel(int tex_idx, int x, int y, const float* rgb);
+	void GetLuxel(int tex_idx, int x, int y, float* rgb) const;
+	// 0 to 255
+	int GetIntensity(int tex_idx, int x, int y) const;
 
 	void CreatetTextures(const ur::Device& dev);
+	void CreatetTextures(TextureUploader& uploader);
 
 	unsigned int GetTexID(int idx) const;
+	// pages sent by the last CreatetTextures(), headless ones have no texture
+	int GetUploadedPages() const { return m_uploaded_pages; }
+
+	// pages with any block allocated, and the bytes held for the pixels
+	int GetUsedPages() const;
+	size_t GetPageBytes() const { return BLOCK_WIDTH * BLOCK_HEIGHT * m_bpp; }
+	size_t GetReservedBytes() const { return m_lightmaps.capacity(); }
 
 	void Clear();
 
+	// reports the AllocBlock time gathered since the last flush
+	void FlushProfile();
+
+	// the default MapContext's
+	static Lightmaps* Instance();
+
 public:
 	static const int BLOCK_WIDTH  = 128;
 	static const int BLOCK_HEIGHT = 128;;
 
 	static const int MAX_LIGHTMAPS = 512;
 
-	static const int BPP = 4;
+private:
+	void FillPages(size_t begin, size_t end);
 
 private:
+	Format m_format;
+	int    m_bpp;
+
 	int	m_allocated[MAX_LIGHTMAPS][BLOCK_WIDTH];
 	int m_last_lightmap_allocated;
 
-	uint8_t m_lightmaps[MAX_LIGHTMAPS * BPP * BLOCK_WIDTH * BLOCK_HEIGHT];
+	// pages up to the last one allocated into, fully lit until written
+	std::vector<uint8_t> m_lightmaps;
 
 	ur::TexturePtr m_textures[MAX_LIGHTMAPS];
+	int m_uploaded_pages;
 
-	CU_SINGLETON_DECLARATION(Lightmaps);
+	ProfileTimer m_alloc_timer;
 
 }; // Lightmaps
 
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "quake/MapSpatialIndex.h"
+#include "quake/SurfaceFlags.h"
+
+#include <SM_Vector.h>
+
+#include <vector>
+#include <memory>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+// Box traces against the brushes of a parsed map, for a game server. Like
+// quake's clipping hulls every brush is expanded by each hull box: its
+// planes are pushed out by the box and bevel planes are added at the
+// bounds and sharp edges, so a box trace is a point trace against the
+// expanded brush. Brushes are found through a MapSpatialIndex.
+class MapCollision
+{
+public:
+	// box around the traced position, in parser space (y up)
+	struct Hull
+	{
+		sm::vec3 min;
+		sm::vec3 max;
+	};
+
+	static const Hull POINT_HULL;
+	static const Hull PLAYER_HULL;    // quake's -16 -16 -24, 16 16 32
+	static const Hull SHAMBLER_HULL;  // quake's -32 -32 -24, 32 32 64
+
+	struct Trace
+	{
+		float    fraction = 1;  // of the move done, 1 if nothing was hit
+		sm::vec3 end;
+		sm::vec3 normal;        // of the plane hit
+		int      brush = -1;    // index into GetBrushes()
+		uint32_t contents = 0;  // of the brush hit
+		bool     start_solid = false;
+		bool     all_solid = false;
+	};
+
+	static const uint32_t MASK_SOLID = ContentFlags::Solid | ContentFlags::Window;
+	static const uint32_t MASK_PLAYER_SOLID = MASK_SOLID | ContentFlags::PlayerClip;
+
+public:
+	// contents come from the faces the parser stored on the entities, brushes
+	// without are solid
+	void Build(const std::vector<std::shared_ptr<MapEntity>>& entities,
+		const std::vector<Hull>& hulls);
+	void Clear();
+
+	// moves the box of hull from start to end until it touches a brush
+	// with contents in mask
+	void TraceBox(size_t hull, const sm::vec3& start, const sm::vec3& end,
+		Trace& trace, uint32_t mask = MASK_PLAYER_SOLID) const;
+	void TraceBoxBatch(size_t hull, const sm::vec3* start, const sm::vec3* end, size_t count,
+		Trace* traces, uint32_t mask = MASK_PLAYER_SOLID) const;
+
+	// contents of all brushes the box of hull at pos is inside of, 0 if empty
+	uint32_t PointContents(size_t hull, const sm::vec3& pos) const;
+
+	auto& GetHulls() const { return m_hulls; }
+	auto& GetBrushes() const { return m_index.GetBrushes(); }
+
+private:
+	struct PlaneRange
+	{
+		uint32_t first;
+		uint32_t count;
+	};
+
+private:
+	void ClipToBrush(size_t hull, uint32_t brush, const sm::vec3& start,
+		const sm::vec3& end, Trace& trace) const;
+
+	bool IsInside(size_t hull, uint32_t brush, const sm::vec3& pos) const;
+
+private:
+	std::vector<Hull> m_hulls;
+
+	MapSpatialIndex m_index;
+	std::vector<uint32_t> m_contents;
+
+	// brush and bevel planes with outward normals shared by all hulls, each
+	// hull has its own distances. ranges are padded to a multiple of 4
+	std::vector<float> m_nx, m_ny, m_nz;
+	std::vector<std::vector<float>> m_dists;
+	std::vector<PlaneRange> m_plane_ranges;
+
+}; // MapCollision
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+
+namespace quake
+{
+
+class TextureManager;
+class Lightmaps;
+class Profiler;
+
+// Per map state, the texture registry, the lightmap atlas and a profiler.
+// Loads that use their own context don't see each other and can run in
+// parallel, the default context is what TextureManager::Instance() and
+// Lightmaps::Instance() return and profiles into Profiler::Instance().
+class MapContext
+{
+public:
+	MapContext();
+	~MapContext();
+
+	TextureManager& GetTextures() { return *m_textures; }
+	const TextureManager& GetTextures() const { return *m_textures; }
+
+	Lightmaps& GetLightmaps() { return *m_lightmaps; }
+	const Lightmaps& GetLightmaps() const { return *m_lightmaps; }
+
+	// recording into it doesn't change the map, so also for const contexts
+	Profiler& GetProfiler() const { return *m_profiler; }
+
+	static MapContext& Default();
+
+private:
+	explicit MapContext(Profiler* profiler);
+
+	MapContext(const MapContext&) = delete;
+	MapContext& operator = (const MapContext&) = delete;
+
+private:
+	std::unique_ptr<TextureManager> m_textures;
+	std::unique_ptr<Lightmaps>      m_lightmaps;
+
+	std::unique_ptr<Profiler> m_own_profiler;
+	Profiler* m_profiler;
+
+}; // MapContext
+
+}
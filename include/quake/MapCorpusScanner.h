@@ -0,0 +1,103 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+namespace quake
+{
+
+// Texture, wad and entity class usage over a directory of .map files, the
+// quake-scan tool. Files are parsed on all cores with the brush geometry
+// off, only the attributes and the face texture names are read.
+class MapCorpusScanner
+{
+public:
+	struct Params
+	{
+		std::string dir;
+		bool recursive = true;
+		std::string ext = ".map";   // compared case insensitive
+
+		// searched for the wads after the map's own directory
+		std::vector<std::string> wad_dirs;
+
+		size_t threads = 0;         // 0 for all cores
+	};
+
+	struct WadResult
+	{
+		std::string name;           // file name, lower case
+		bool found = false;         // next to the map or in a wad dir
+
+		size_t textures = 0;        // used by the map
+		size_t faces = 0;
+	};
+
+	struct MapResult
+	{
+		std::string path;
+		std::string error;          // empty if parsed
+
+		size_t entities = 0;
+		size_t faces = 0;
+
+		std::vector<WadResult> wads;                      // in the order of the worldspawn "wad" key
+		std::unordered_map<std::string, size_t> textures; // faces per texture
+		// the first wad with the texture, as the engine looks them up,
+		// textures in none of the wads are left out
+		std::unordered_map<std::string, std::string> texture_wads;
+		std::unordered_map<std::string, size_t> classnames;
+	};
+
+	struct Usage
+	{
+		size_t count = 0;           // faces for textures and wads, entities for classnames
+		size_t maps = 0;
+	};
+
+	struct WadUsage : Usage
+	{
+		// textures taken from this wad, faces and maps each
+		std::map<std::string, Usage> textures;
+	};
+
+	struct Result
+	{
+		std::vector<MapResult> maps;
+
+		// over all maps, sorted by name
+		std::map<std::string, Usage> textures;
+		std::map<std::string, Usage> classnames;
+		std::map<std::string, WadUsage> wads;
+		// textures in none of their map's wads
+		std::map<std::string, Usage> unresolved;
+
+		size_t failed = 0;
+		size_t bytes = 0;
+		double seconds = 0;
+	};
+
+public:
+	static Result Scan(const Params& params);
+
+	// the wads are resolved against the map's directory and wad_dirs
+	static MapResult ScanFile(const std::string& filepath, size_t* bytes = nullptr,
+		const std::vector<std::string>& wad_dirs = std::vector<std::string>());
+
+	// totals and every map with its own usage
+	static bool WriteJson(const Result& result, const std::string& filepath);
+	// one row per map and name: map,kind,name,count,wad with kind one of
+	// texture, classname, wad or unresolved, wad is set for textures only
+	static bool WriteCsv(const Result& result, const std::string& filepath);
+
+private:
+	// texture names per wad file, shared by the workers
+	class WadNames;
+
+	static MapResult ScanMap(const std::string& filepath, size_t* bytes, WadNames& wad_names);
+
+}; // MapCorpusScanner
+
+}
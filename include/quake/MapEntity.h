@@ -1,10 +1,15 @@
 #pragma once
 
 #include "quake/MapAttributes.h"
+#include "quake/SurfaceFlags.h"
+
+#include <SM_Vector.h>
 
 #include <vector>
 #include <memory>
 
+#include <stdint.h>
+
 namespace pm3 { class Polytope; }
 
 namespace quake
@@ -15,6 +20,32 @@ struct MapEntity
 	std::vector<EntityAttribute> attributes;
 	std::vector<std::shared_ptr<pm3::Polytope>> brushes;
 
+	// contents, flags and value of every face as parsed, or as implied by
+	// the texture name, brush i's from surface_offsets[i] in face order.
+	// pm3::Polytope keeps the faces in the order the parser passed them, so
+	// face k of brushes[i] is surface k, see GetSurfaceCount().
+	// empty for brushes not made by the parser
+	std::vector<FaceSurface> surfaces;
+	std::vector<uint32_t>    surface_offsets;
+	// valve 220 maps only, the s and t axis of every face in parser space,
+	// two per face at twice the surface offsets
+	std::vector<sm::vec3>    tex_axes;
+
+	// null if the brush has none
+	const FaceSurface* GetSurfaces(size_t brush) const {
+		return brush < surface_offsets.size() ? surfaces.data() + surface_offsets[brush] : nullptr;
+	}
+	size_t GetSurfaceCount(size_t brush) const {
+		if (brush >= surface_offsets.size()) {
+			return 0;
+		}
+		const size_t end = brush + 1 < surface_offsets.size() ? surface_offsets[brush + 1] : surfaces.size();
+		return end - surface_offsets[brush];
+	}
+	const sm::vec3* GetTexAxes(size_t brush) const {
+		return brush < surface_offsets.size() && !tex_axes.empty() ? tex_axes.data() + surface_offsets[brush] * 2 : nullptr;
+	}
+
 	//size_t start_line;
 	//size_t line_count;
 
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "quake/MapAttributes.h"
+
+#include <SM_Vector.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+// Typed columns of the attributes most code reads, decoded once while
+// parsing. Row i is entity i of MapParser::GetAllEntities(), the raw
+// strings stay in MapEntity::attributes. Classnames and targetnames are
+// interned, so they compare as integers.
+class MapEntityTable
+{
+public:
+	static const uint32_t NO_NAME = 0xffffffff;
+
+public:
+	void AddEntity(const std::vector<EntityAttribute>& attributes);
+
+	void Clear();
+
+	size_t Size() const { return m_classnames.size(); }
+
+	// id of an interned name, NO_NAME if no entity uses it
+	uint32_t FindName(const std::string& name) const;
+	auto& GetNames() const { return m_names; }
+
+	auto& GetClassnames() const  { return m_classnames; }
+	auto& GetTargetnames() const { return m_targetnames; }
+	auto& GetSpawnflags() const  { return m_spawnflags; }
+
+	// in parser space like the brushes (y and z swapped), NaN without origin
+	auto& GetOriginsX() const { return m_origin_x; }
+	auto& GetOriginsY() const { return m_origin_y; }
+	auto& GetOriginsZ() const { return m_origin_z; }
+	sm::vec3 GetOrigin(size_t entity) const;
+	bool HasOrigin(size_t entity) const;
+
+	// pitch, yaw, roll from "angles", "mangle" or the yaw of "angle"
+	auto& GetAngles() const { return m_angles; }
+
+	// entities with an origin in the box and any of the mask's spawnflags,
+	// a mask of 0 matches all
+	void QueryBox(const sm::vec3& min, const sm::vec3& max, uint32_t spawnflags_mask,
+		std::vector<uint32_t>& entities) const;
+	void QueryClassname(uint32_t classname, std::vector<uint32_t>& entities) const;
+
+	size_t GetMemoryBytes() const;
+
+private:
+	uint32_t InternName(const std::string& name);
+
+private:
+	std::vector<std::string> m_names;
+	std::unordered_map<std::string, uint32_t> m_name2id;
+
+	std::vector<uint32_t> m_classnames;
+	std::vector<uint32_t> m_targetnames;
+	std::vector<uint32_t> m_spawnflags;
+
+	std::vector<float> m_origin_x, m_origin_y, m_origin_z;
+	std::vector<sm::vec3> m_angles;
+
+}; // MapEntityTable
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <SM_Vector.h>
+#include <SM_Plane.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+// Optional per-map index of the planes and texture projections faces
+// share, so faces on the same plane or with the same projection compare
+// by index. Planes are stored in pairs like quake's bsp: plane i and
+// i ^ 1 are the same plane facing opposite directions.
+// It saves no memory, pm3::Polytope::Face keeps its own plane and tex_map
+// and the table adds a Face per face plus the unique entries on top.
+// Compact() drops the lookup hashes once nothing more is added. Face
+// surfaces are on MapEntity, not repeated here.
+class MapFaceTable
+{
+public:
+	struct TexInfo
+	{
+		uint32_t tex;        // index into GetTextures()
+		sm::vec2 offset;
+		float    angle;
+		sm::vec2 scale;
+	};
+
+	struct Face
+	{
+		uint32_t plane;
+		uint32_t texinfo;
+	};
+
+	struct Brush
+	{
+		uint32_t entity;     // index into MapParser::GetAllEntities()
+		uint32_t brush;      // index into MapEntity::brushes
+		uint32_t first_face;
+		uint32_t num_faces;  // in the order the faces were passed to pm3::Polytope
+	};
+
+public:
+	// planes whose normals are within NORMAL_EPSILON and distances within
+	// DIST_EPSILON share an entry, entries snap normals close to an axis
+	// and distances close to an integer. the face keeps its own plane
+	uint32_t AddPlane(const sm::Plane& plane);
+	uint32_t AddTexture(const std::string& name);
+	uint32_t AddTexInfo(uint32_t tex, const sm::vec2& offset, float angle, const sm::vec2& scale);
+
+	void AddBrush(uint32_t entity, uint32_t brush, const std::vector<Face>& faces);
+
+	// frees the lookup hashes and spare capacity, the next Add*() rebuilds them
+	void Compact();
+	void Clear();
+
+	size_t GetMemoryBytes() const;
+
+	auto& GetPlanes() const   { return m_planes; }
+	auto& GetTextures() const { return m_textures; }
+	auto& GetTexInfos() const { return m_texinfos; }
+	auto& GetFaces() const    { return m_faces; }
+	auto& GetBrushes() const  { return m_brushes; }
+
+	static bool IsOppositePlane(uint32_t p0, uint32_t p1) { return (p0 ^ 1) == p1; }
+
+public:
+	static const float NORMAL_EPSILON;
+	static const float DIST_EPSILON;
+
+private:
+	static void SnapPlane(sm::vec3& normal, float& dist);
+
+	int FindPlane(const sm::vec3& normal, float dist) const;
+
+	static uint64_t HashTexInfo(const TexInfo& info);
+	void BuildIndex();
+
+private:
+	std::vector<sm::Plane> m_planes;
+	std::unordered_multimap<int, uint32_t> m_plane_hash;
+
+	std::vector<std::string> m_textures;
+	std::unordered_map<std::string, uint32_t> m_tex2idx;
+
+	std::vector<TexInfo> m_texinfos;
+	std::unordered_multimap<uint64_t, uint32_t> m_texinfo_hash;
+
+	std::vector<Face>  m_faces;
+	std::vector<Brush> m_brushes;
+
+	bool m_indexed = true;
+
+}; // MapFaceTable
+
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "quake/WadFileLoader.h"
+#include "quake/MapContext.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+
+namespace quake
+{
+
+class TaskPool;
+class Palette;
+class PakFileSystem;
+class MapParser;
+class TextureUploader;
+class TextureDiskCache;
+
+// Loads a .map and the wads named by its worldspawn in the background.
+// Parsing and wad decoding run on the task pool, wad decoding starts as
+// soon as the "wad" key is read so it overlaps the parse. Only the texture
+// uploads touch the device, they are done in slices from Update() on the
+// render thread.
+class MapLoader
+{
+public:
+	struct Params
+	{
+		std::string map_filepath;
+
+		// wads are looked up in the paks, then as given, then relative to base_dir
+		std::string base_dir;
+		const PakFileSystem* paks = nullptr;
+
+		bool create_lightmaps = false;
+
+		// block compress the textures on the decode tasks, see
+		// WadFileLoader::EnableCompression
+		bool compress_textures = false;
+		TextureCompressor::Params compression;
+		const TextureDiskCache* texture_cache = nullptr;
+	};
+
+	enum class Status
+	{
+		Idle,
+		Running,
+		Uploading,
+		Done,
+		Cancelled,
+		Failed,
+	};
+
+public:
+	// textures and lightmaps go to ctx, loaders with different contexts can
+	// run at the same time
+	MapLoader(TaskPool& pool, const Palette& palette,
+		MapContext& ctx = MapContext::Default());
+	~MapLoader();
+
+	bool Start(const Params& params);
+	void Cancel();
+
+	// render thread only, uploads until budget_ms is spent
+	Status Update(TextureUploader& uploader, double budget_ms);
+
+	Status GetStatus() const { return m_status; }
+	// 0 to 1, parse, decode and upload stages weighted together
+	float GetProgress() const;
+	std::string GetError() const;
+
+	// valid once the status is Uploading or Done
+	auto& GetParser() const { return m_parser; }
+
+	// the .map text once parsed and the decoded pixels not uploaded yet,
+	// render thread only like Update()
+	size_t GetMapDataBytes() const { return m_map_data.capacity(); }
+	size_t GetDecodedBytes() const;
+
+private:
+	void ParseTask();
+	void DecodeTask(const std::string& wad_path, size_t wad_idx);
+
+	void SubmitWads(const std::string& wad_key);
+
+	// the decoded copy of hash with pixels in the wads after wad_idx, false
+	// if it may still come from a wad not decoded yet
+	bool TakePixels(uint64_t hash, size_t wad_idx, WadFileLoader::DecodedTexture& tex);
+
+	void Fail(const std::string& msg);
+
+	void WaitAll();
+
+private:
+	TaskPool&      m_pool;
+	const Palette& m_palette;
+	MapContext&    m_ctx;
+
+	Params m_params;
+
+	std::atomic<Status> m_status;
+	std::atomic<bool>   m_cancel;
+
+	std::vector<char> m_map_data;
+	std::unique_ptr<MapParser> m_parser = nullptr;
+
+	std::future<void> m_parse_future;
+
+	struct DecodedWad
+	{
+		bool done = false;
+		std::vector<WadFileLoader::DecodedTexture> textures;
+	};
+
+	mutable std::mutex m_mtx;
+	std::vector<std::future<void>> m_wad_futures;
+	// in the order of the "wad" key, the wads decode in parallel but are
+	// uploaded in this order so the first wad with a name wins as before
+	std::vector<DecodedWad> m_wads;
+	size_t m_upload_wad = 0, m_upload_tex = 0;
+	// content hashes some wad task is decoding, later copies skip the decode
+	std::unordered_set<uint64_t> m_claimed;
+	std::string m_error;
+
+	std::atomic<size_t> m_wads_total, m_wads_decoded;
+	std::atomic<size_t> m_tex_total, m_tex_uploaded;
+
+}; // MapLoader
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "quake/MapEntity.h"
+#include "quake/HiddenFaceRemoval.h"
+#include "quake/MapContext.h"
+
+#include <unirender/typedef.h>
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+struct MapMesh
+{
+	struct Vertex
+	{
+		float pos[3];
+		float normal[3];
+		float uv[2];
+	};
+
+	// one draw call, ordered by texture name
+	struct Range
+	{
+		std::string    tex_name;
+		ur::TexturePtr tex;
+		uint32_t       first_index;
+		uint32_t       index_count;
+	};
+
+	std::vector<Vertex>   vertices;
+	std::vector<uint32_t> indices;
+	std::vector<Range>    ranges;
+
+}; // MapMesh
+
+// Turns all brushes of a parsed map into a single interleaved vertex and
+// index buffer with one contiguous index range per texture.
+class MapMeshCompiler
+{
+public:
+	// texture sizes are looked up in ctx
+	MapMeshCompiler(const MapContext& ctx = MapContext::Default());
+
+	void SetWeldVertices(bool weld) { m_weld = weld; }
+	void SetRemoveHiddenFaces(bool remove) { m_remove_hidden_faces = remove; }
+	// faces never drawn, by their quake 2 flags or their texture, eg. skip,
+	// clip or trigger, see FaceSurface::IsDrawn()
+	void SetSkipInvisibleFaces(bool skip) { m_skip_invisible_faces = skip; }
+
+	void Compile(const std::vector<std::shared_ptr<MapEntity>>& entities, MapMesh& mesh);
+
+	auto& GetHiddenFaceStats() const { return m_hidden_face_stats; }
+
+private:
+	const MapContext& m_ctx;
+
+	bool m_weld = true;
+	bool m_remove_hidden_faces = false;
+	bool m_skip_invisible_faces = false;
+
+	HiddenFaceRemoval::Stats m_hidden_face_stats;
+
+}; // MapMeshCompiler
+
+}
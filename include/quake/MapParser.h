@@ -1,6 +1,12 @@
 #pragma once
 
 #include "quake/MapEntity.h"
+#include "quake/MapFaceTable.h"
+#include "quake/MapEntityTable.h"
+#include "quake/SurfaceFlags.h"
+#include "quake/MapContext.h"
+#include "quake/MapScanIndex.h"
+#include "quake/Profiler.h"
 
 #include <lexer/Tokenizer.h>
 #include <lexer/Parser.h>
@@ -9,6 +15,8 @@
 
 #include <vector>
 #include <set>
+#include <unordered_map>
+#include <atomic>
 
 namespace quake
 {
@@ -44,17 +52,33 @@ class MapTokenizer : public lexer::Tokenizer<MapToken::Type>
 {
 public:
 	MapTokenizer(const std::string& str);
+	MapTokenizer(const char* begin, const char* end);
 
 	void SetSkipEol(bool skip_eol);
 
+	// hides the base one to count the consumed tokens, PeekToken() goes
+	// through EmitToken() as well
+	Token NextToken();
+
+	size_t GetTokenCount() const { return m_token_count; }
+
 protected:
 	virtual Token EmitToken() override;
 
-	static const std::string& NumberDelim();
+private:
+	Token ReadToken();
+
+	// Integer, Decimal, or 0 when [begin, end) is no number
+	static MapToken::Type ClassifyNumber(const char* begin, const char* end);
 
 private:
 	bool m_skip_eol;
 
+	const char*  m_begin;
+	MapScanIndex m_index;
+
+	size_t m_token_count = 0;
+
 }; // MapTokenizer
 
 struct ExtraAttribute;
@@ -63,20 +87,59 @@ class MapParser : public lexer::Parser<MapToken::Type>
 {
 public:
 	MapParser(const std::string& str);
+	// parse straight from memory, eg. a pak file, the buffer must outlive the parser
+	MapParser(const char* begin, const char* end);
 	virtual ~MapParser() override;
 
+	// standard, quake 2 and valve 220 maps
 	void Parse();
 
 	const std::shared_ptr<MapEntity> GetWorldEntity() const;
 	auto& GetAllEntities() const { return m_entities; }
 
-	void UpdateFaceTextures();
+	void UpdateFaceTextures(const MapContext& ctx = MapContext::Default());
+
+	// index the faces' planes and texture projections in a per-map table,
+	// the faces are left as parsed. must be called before Parse()
+	void EnableFaceTable(bool enable);
+	auto& GetFaceTable() const { return m_face_table; }
+
+	// decode the common attributes into typed columns, must be called
+	// before Parse()
+	void EnableEntityTable(bool enable);
+	auto& GetEntityTable() const { return m_entity_table; }
+
+	// without geometry the brushes aren't built, their faces only count
+	// towards GetTextureUsage(). for tools which need the attributes and
+	// texture names, must be called before Parse()
+	void EnableBrushGeometry(bool enable) { m_brush_geometry = enable; }
+	// faces per texture name, filled without geometry
+	auto& GetTextureUsage() const { return m_texture_usage; }
+
+	// brushes left out while parsing, before any polytope work. triggers
+	// have trigger contents or belong to a trigger_ entity, invisible
+	// brushes have no drawn face, eg. clip, skip or origin brushes
+	void SetDropTriggers(bool drop) { m_drop_triggers = drop; }
+	void SetDropInvisibleBrushes(bool drop) { m_drop_invisible = drop; }
+	size_t GetDroppedBrushCount() const { return m_dropped_brushes; }
+
+	// polled between entities, Parse() returns early with the entities
+	// parsed so far once the flag is raised
+	void SetCancelFlag(const std::atomic<bool>* cancel) { m_cancel = cancel; }
+	bool IsCancelled() const { return m_cancel && *m_cancel; }
 
 protected:
 	void ParseEntities(MapFormat::Type format);
 	void ParseBrushes(MapFormat::Type format);
 	void ParseBrushFaces(MapFormat::Type format);
 
+	// EndBrush() only records the faces, the polytopes of all brushes are
+	// built here afterwards in parallel, also when the parse throws so no
+	// entity is left with an empty brush slot
+	void BuildPolytopes();
+	// the faces of a brush the parse stopped in
+	void DiscardCurrBrush();
+
 	void Reset();
 
 private:
@@ -114,12 +177,44 @@ private:
 private:
 	MapTokenizer    m_tokenizer;
 	MapFormat::Type m_format;
+	// valve 220 is told apart by the first face
+	bool m_format_checked = false;
 
 	std::vector<std::shared_ptr<MapEntity>> m_entities;
 	int m_world_entry_idx = -1;
 
 	std::shared_ptr<MapEntity> m_curr_entity = nullptr;
 	std::vector<pm3::Polytope::FacePtr>  m_curr_faces;
+	// explicit quake 2 values or derived from the texture name
+	std::vector<FaceSurface> m_curr_surfaces;
+	// valve 220 only
+	std::vector<sm::vec3> m_curr_tex_axes;
+	bool m_curr_entity_trigger = false;
+
+	struct PendingBrush
+	{
+		MapEntity* entity;
+		size_t     index;
+		std::vector<pm3::Polytope::FacePtr> faces;
+	};
+	std::vector<PendingBrush> m_pending_brushes;
+
+	std::shared_ptr<MapFaceTable> m_face_table = nullptr;
+	std::vector<MapFaceTable::Face> m_curr_face_refs;
+
+	std::shared_ptr<MapEntityTable> m_entity_table = nullptr;
+
+	bool m_brush_geometry = true;
+
+	bool m_drop_triggers  = false;
+	bool m_drop_invisible = false;
+	size_t m_dropped_brushes = 0;
+	std::unordered_map<std::string, size_t> m_texture_usage;
+
+	const std::atomic<bool>* m_cancel = nullptr;
+
+	ProfileTimer m_face_timer;
+	ProfileTimer m_brush_timer;
 
 	typedef MapTokenizer::Token Token;
 
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <SM_Vector.h>
+
+#include <string>
+#include <vector>
+
+#include <float.h>
+#include <stdint.h>
+
+namespace quake
+{
+
+class MapEntityTable;
+
+// K-d tree over the origins of point entities, from the decoded origins of
+// a MapEntityTable. The tree is implicit: each range of points is split at
+// its median along the widest axis, small ranges are scanned. Queries are
+// const and can run from any number of threads.
+class MapPointIndex
+{
+public:
+	struct Neighbor
+	{
+		uint32_t entity;   // index into MapParser::GetAllEntities()
+		float    dist2;    // squared distance
+	};
+
+public:
+	// entities with an origin whose classname is one of classnames, or any
+	// if empty. a trailing '*' matches a prefix, eg. "info_player_*"
+	void Build(const MapEntityTable& table,
+		const std::vector<std::string>& classnames = std::vector<std::string>());
+	void Clear();
+
+	size_t Size() const { return m_points.size(); }
+
+	void QueryRadius(const sm::vec3& center, float radius, std::vector<uint32_t>& entities) const;
+	void QueryBox(const sm::vec3& min, const sm::vec3& max, std::vector<uint32_t>& entities) const;
+
+	// up to k closest within max_dist, nearest first, out takes k entries
+	size_t QueryNearest(const sm::vec3& pos, size_t k, Neighbor* out, float max_dist = FLT_MAX) const;
+	// k results per position into out, counts of the found ones into found
+	void QueryNearestBatch(const sm::vec3* pos, size_t count, size_t k, Neighbor* out,
+		size_t* found, float max_dist = FLT_MAX) const;
+
+private:
+	struct Point
+	{
+		float    pos[3];
+		uint32_t entity;
+	};
+
+	void BuildRecursive(size_t begin, size_t end);
+
+	void QueryRadiusRecursive(size_t begin, size_t end, const float* center, float radius2,
+		std::vector<uint32_t>& entities) const;
+	void QueryBoxRecursive(size_t begin, size_t end, const float* min, const float* max,
+		std::vector<uint32_t>& entities) const;
+	void QueryNearestRecursive(size_t begin, size_t end, const float* pos, size_t k,
+		Neighbor* heap, size_t& count, float& worst2) const;
+
+private:
+	std::vector<Point> m_points;
+
+	// split axis of the range whose median is point i
+	std::vector<uint8_t> m_axes;
+
+}; // MapPointIndex
+
+}
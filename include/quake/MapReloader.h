@@ -0,0 +1,75 @@
+#pragma once
+
+#include "quake/MapEntity.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+// Keeps the result of the last parse and on reload only re-parses the
+// top-level entities whose text changed, the others are reused by pointer.
+// A copy of the last text is kept to confirm unchanged entities byte for
+// byte, the changed ones are parsed together in one MapParser run.
+class MapReloader
+{
+public:
+	struct Changes
+	{
+		// indices into GetAllEntities() of the entities parsed by this reload
+		std::vector<size_t> parsed;
+		// entities of the previous parse which no longer exist
+		std::vector<std::shared_ptr<MapEntity>> removed;
+
+		size_t reused = 0;
+	};
+
+public:
+	const Changes& Reload(const std::string& str);
+	const Changes& Reload(const char* begin, const char* end);
+
+	void Clear();
+
+	const std::shared_ptr<MapEntity> GetWorldEntity() const;
+	auto& GetAllEntities() const { return m_entities; }
+
+	auto& GetChanges() const { return m_changes; }
+
+private:
+	struct EntityKey
+	{
+		uint64_t hash;
+		size_t   size;
+
+		bool operator == (const EntityKey& key) const {
+			return hash == key.hash && size == key.size;
+		}
+	};
+
+	struct EntityKeyHash
+	{
+		size_t operator () (const EntityKey& key) const {
+			return static_cast<size_t>(key.hash ^ (key.size * 0x9e3779b97f4a7c15ull));
+		}
+	};
+
+private:
+	std::vector<std::shared_ptr<MapEntity>> m_entities;
+	// of each entity's text in m_text
+	std::vector<EntityKey> m_keys;
+	std::vector<size_t>    m_offsets;
+
+	std::string m_text;
+
+	int m_world_entry_idx = -1;
+
+	Changes m_changes;
+
+}; // MapReloader
+
+}
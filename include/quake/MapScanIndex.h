@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+// First stage of MapTokenizer, one bit per input byte for whitespace and
+// for the number delimiters (whitespace or ')'), classified 16 or 32 bytes
+// at a time. The tokenizer then finds where a run of whitespace or a token
+// ends with a bit scan instead of testing every char, and numbers are read
+// once instead of being tried as integer, then decimal, then word.
+class MapScanIndex
+{
+public:
+	void Build(const char* begin, const char* end);
+
+	// first offset from pos which isn't whitespace, or the size
+	size_t SkipWhitespace(size_t pos) const;
+	// first offset from pos which is whitespace, or the size
+	size_t FindWhitespace(size_t pos) const;
+	// first offset from pos which is whitespace or ')', or the size
+	size_t FindNumberDelim(size_t pos) const;
+
+	size_t Size() const { return m_size; }
+
+private:
+	size_t FindSet(const std::vector<uint64_t>& bits, size_t pos) const;
+	size_t FindClear(const std::vector<uint64_t>& bits, size_t pos) const;
+
+private:
+	size_t m_size = 0;
+
+	std::vector<uint64_t> m_whitespace;
+	std::vector<uint64_t> m_number_delim;
+
+}; // MapScanIndex
+
+}
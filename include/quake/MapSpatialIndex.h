@@ -0,0 +1,172 @@
+#pragma once
+
+#include "quake/MapEntity.h"
+
+#include <SM_Vector.h>
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include <float.h>
+#include <stdint.h>
+#include <assert.h>
+
+namespace quake
+{
+
+// SAH bvh over the brushes of a parsed map
+class MapSpatialIndex
+{
+public:
+	struct BrushRef
+	{
+		uint32_t entity;     // index into MapParser::GetAllEntities()
+		uint32_t brush;      // index into MapEntity::brushes
+	};
+
+	struct Ray
+	{
+		sm::vec3 origin;
+		sm::vec3 dir;        // needn't be normalized, distances are in units of dir
+		float    max_dist = FLT_MAX;
+	};
+
+	struct Hit
+	{
+		int      brush = -1; // index into GetBrushes()
+		float    dist = FLT_MAX;
+		sm::vec3 normal;
+	};
+
+public:
+	void Build(const std::vector<std::shared_ptr<MapEntity>>& entities);
+	void Clear();
+
+	// closest brush along the ray, a ray starting inside a brush hits it at 0
+	bool Raycast(const Ray& ray, Hit& hit) const;
+	void RaycastBatch(const Ray* rays, size_t count, Hit* hits) const;
+
+	// brushes whose bounds overlap the box, as indices into GetBrushes()
+	void QueryBox(const sm::vec3& min, const sm::vec3& max, std::vector<uint32_t>& brushes) const;
+
+	// calls func(brush) for the brushes whose bounds, grown by a box [min, max]
+	// moving along with the segment, the segment from start to start + delta
+	// may touch. func returns the fraction of the segment still of interest,
+	// nodes past it are skipped
+	template <typename Func>
+	void QuerySweep(const sm::vec3& start, const sm::vec3& delta,
+		const sm::vec3& min, const sm::vec3& max, Func func) const;
+
+	auto& GetBrushes() const { return m_brushes; }
+
+private:
+	struct Node
+	{
+		float    min[3];
+		uint32_t offset;     // first ref for leaves, right child for inner nodes
+		float    max[3];
+		uint32_t count;      // 0 for inner nodes
+
+		bool IsLeaf() const { return count != 0; }
+	};
+
+	// brush planes with outward normals, padded to a multiple of 4
+	struct PlaneSoA
+	{
+		std::vector<float> nx, ny, nz, d;
+	};
+
+	struct PlaneRange
+	{
+		uint32_t first;
+		uint32_t count;
+	};
+
+	// the traversal stacks hold at most one node per level plus the root,
+	// deeper subtrees become leaves however many brushes they have
+	static const int STACK_SIZE = 64;
+	static const int MAX_DEPTH  = STACK_SIZE - 1;
+
+private:
+	uint32_t BuildRecursive(uint32_t first, uint32_t count, std::vector<Node>& nodes, int depth);
+
+	bool IntersectBrush(uint32_t brush, const Ray& ray, float max_dist, float& dist, sm::vec3& normal) const;
+
+private:
+	std::vector<BrushRef> m_brushes;
+
+	std::vector<float> m_bounds;     // min xyz, max xyz per brush
+	std::vector<float> m_centroids;  // xyz per brush
+
+	PlaneSoA m_planes;
+	std::vector<PlaneRange> m_plane_ranges;
+
+	std::vector<uint32_t> m_refs;    // leaf brush indices
+	std::vector<Node> m_nodes;
+
+}; // MapSpatialIndex
+
+template <typename Func>
+void MapSpatialIndex::QuerySweep(const sm::vec3& start, const sm::vec3& delta,
+	                             const sm::vec3& min, const sm::vec3& max, Func func) const
+{
+	if (m_nodes.empty()) {
+		return;
+	}
+
+	float inv[3];
+	for (int i = 0; i < 3; ++i) {
+		inv[i] = delta[i] != 0 ? 1.0f / delta[i] : FLT_MAX;
+	}
+
+	// a box at p overlaps the bounds if p is within them grown by -max and -min
+	auto hit_bounds = [&](const float* bmin, const float* bmax, float t_max) -> bool
+	{
+		float t0 = 0, t1 = t_max;
+		for (int i = 0; i < 3; ++i)
+		{
+			float a = (bmin[i] - max[i] - start[i]) * inv[i];
+			float b = (bmax[i] - min[i] - start[i]) * inv[i];
+			if (a > b) {
+				std::swap(a, b);
+			}
+			t0 = std::max(t0, a);
+			t1 = std::min(t1, b);
+		}
+		return t0 <= t1;
+	};
+
+	float frac = 1.0f;
+
+	uint32_t stack[STACK_SIZE];
+	int sp = 0;
+	stack[sp++] = 0;
+	while (sp > 0)
+	{
+		const uint32_t idx = stack[--sp];
+		const Node& node = m_nodes[idx];
+		if (!hit_bounds(node.min, node.max, frac)) {
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = 0; i < node.count; ++i)
+			{
+				const uint32_t brush = m_refs[node.offset + i];
+				if (hit_bounds(&m_bounds[brush * 6], &m_bounds[brush * 6 + 3], frac)) {
+					frac = std::min(frac, func(brush));
+				}
+			}
+		}
+		else
+		{
+			assert(sp + 2 <= STACK_SIZE);
+			stack[sp++] = node.offset;
+			stack[sp++] = idx + 1;
+		}
+	}
+}
+
+}
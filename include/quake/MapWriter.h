@@ -0,0 +1,46 @@
+#pragma once
+
+#include "quake/MapEntity.h"
+#include "quake/MapParser.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <iosfwd>
+
+namespace quake
+{
+
+// Writes entities back to .map text which MapParser reads to the same
+// planes and texture mappings. Brushes are formatted in parallel chunks,
+// the chunks are written out in order without being joined first.
+class MapWriter
+{
+public:
+	// Standard or Valve, Valve keeps the texture axes read from a valve
+	// map and gets the ones of the standard projection otherwise
+	MapWriter(MapFormat::Type format = MapFormat::Standard);
+
+	void Write(std::ostream& os, const std::vector<std::shared_ptr<MapEntity>>& entities) const;
+	bool WriteToFile(const std::string& filepath, const std::vector<std::shared_ptr<MapEntity>>& entities) const;
+
+	std::string ToString(const std::vector<std::shared_ptr<MapEntity>>& entities) const;
+
+	// shortest text that reads back to the same float, integers without
+	// a fraction, always with a '.' whatever the locale. buf needs at least
+	// 32 chars, returns the length
+	static size_t FormatFloat(float f, char* buf);
+
+private:
+	template <typename Out>
+	void Emit(Out& out, const std::vector<std::shared_ptr<MapEntity>>& entities) const;
+
+	// tex_axes are MapEntity::GetTexAxes(), may be null
+	void FormatBrush(const pm3::Polytope& brush, const sm::vec3* tex_axes, std::string& out) const;
+
+private:
+	MapFormat::Type m_format;
+
+}; // MapWriter
+
+}
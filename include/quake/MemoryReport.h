@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+class MapParser;
+class MapContext;
+class MapLoader;
+
+namespace MemoryCategory
+{
+	enum Type
+	{
+		EntityAttributes = 0,
+		Entities,           // MapEntity and its brush list
+		Polytopes,          // points, faces and their shared_ptr blocks
+		FaceTexNames,       // heap part of each face's texture name
+		FaceTable,
+		EntityTable,
+		ParserOther,        // texture usage counts
+		MapSource,          // the .map text kept by the loader
+		TextureHost,        // decoded pixels waiting for upload and the registry
+		TextureGpu,         // estimate from the uploaded formats
+		LightmapsUsed,      // pages with any block allocated
+		LightmapsReserved,  // the atlas and the pages it holds, used or not
+
+		MaxCount
+	};
+
+	const char* Name(Type type);
+}
+
+// Byte counts per category for each map and over all of them. Containers
+// are measured by their capacity and strings by their heap buffer, the
+// allocator's own overhead isn't counted.
+class MemoryReport
+{
+public:
+	struct Usage
+	{
+		size_t bytes[MemoryCategory::MaxCount];
+
+		Usage();
+
+		size_t Total() const;
+
+		Usage& operator += (const Usage& usage);
+	};
+
+	struct Map
+	{
+		std::string name;
+		Usage       usage;
+	};
+
+public:
+	// any of them may be null, a context shared by several maps should only
+	// be passed once
+	void AddMap(const std::string& name, const MapParser* parser,
+		const MapContext* ctx = nullptr, const MapLoader* loader = nullptr);
+	void Clear() { m_maps.clear(); }
+
+	auto& GetMaps() const { return m_maps; }
+	Usage GetTotal() const;
+
+	// one line per map and category plus the totals
+	std::string ToString() const;
+
+	static Usage Measure(const MapParser& parser);
+	static Usage Measure(const MapContext& ctx);
+	static Usage Measure(const MapLoader& loader);
+
+private:
+	std::vector<Map> m_maps;
+
+}; // MemoryReport
+
+// helpers for the classes to measure themselves
+namespace MemoryBytes
+{
+	size_t String(const std::string& str);
+
+	template <typename T>
+	size_t Vector(const std::vector<T>& v) {
+		return v.capacity() * sizeof(T);
+	}
+
+	// one node per element plus the bucket array, as libstdc++ and msvc do
+	template <typename Map>
+	size_t Hash(const Map& map) {
+		return map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*))
+			+ map.bucket_count() * sizeof(void*);
+	}
+
+	// std::map and std::set nodes, three links and a color
+	template <typename Map>
+	size_t Tree(const Map& map) {
+		return map.size() * (sizeof(typename Map::value_type) + 4 * sizeof(void*));
+	}
+
+	// make_shared puts the counts and the object in one block
+	template <typename T>
+	size_t Shared(const std::shared_ptr<T>& ptr) {
+		return ptr ? sizeof(T) + 2 * sizeof(void*) : 0;
+	}
+}
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+// read-only view of a file inside a pak, points into the mapped archive
+struct PakFileData
+{
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+
+	bool Empty() const { return data == nullptr; }
+};
+
+// "PACK" archive, memory-mapped for its whole lifetime
+class PakFile
+{
+public:
+	PakFile();
+	~PakFile();
+
+	bool Open(const std::string& filepath);
+	void Close();
+
+	bool IsOpen() const { return m_data != nullptr; }
+
+	struct Entry
+	{
+		std::string name;   // lower case, '/' separated
+		uint32_t    offset;
+		uint32_t    size;
+	};
+
+	auto& GetEntries() const { return m_entries; }
+
+	PakFileData GetFileData(const Entry& entry) const;
+
+	auto& GetFilepath() const { return m_filepath; }
+
+	static std::string NormalizePath(const std::string& path);
+
+private:
+	bool ParseDirectory();
+
+private:
+	std::string m_filepath;
+
+	const unsigned char* m_data;
+	size_t m_size;
+
+#ifdef _WIN32
+	void* m_file_handle;
+	void* m_map_handle;
+#endif // _WIN32
+
+	std::vector<Entry> m_entries;
+
+}; // PakFile
+
+}
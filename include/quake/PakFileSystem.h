@@ -0,0 +1,45 @@
+#pragma once
+
+#include "quake/PakFile.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+namespace quake
+{
+
+class PakFileSystem
+{
+public:
+	// paks mounted later override files of the earlier ones,
+	// so pak1.pak should be mounted after pak0.pak
+	bool Mount(const std::string& pak_filepath);
+
+	// mounts dir/pak0.pak, dir/pak1.pak, ... until the first missing one
+	size_t MountGameDir(const std::string& dir);
+
+	void Clear();
+
+	bool Exists(const std::string& path) const;
+
+	PakFileData Find(const std::string& path) const;
+
+	std::vector<std::string> ListFiles(const std::string& ext = "") const;
+
+private:
+	struct Location
+	{
+		size_t pak_idx;
+		size_t entry_idx;
+	};
+
+private:
+	std::vector<std::unique_ptr<PakFile>> m_paks;
+
+	std::unordered_map<std::string, Location> m_dir;
+
+}; // PakFileSystem
+
+}
@@ -2,6 +2,8 @@
 
 #include <string>
 
+#include <stdint.h>
+
 namespace quake
 {
 
@@ -12,10 +14,15 @@ public:
 	~Palette();
 
 	void LoadFromFile(const std::string& filepath);
+	void LoadFromMemory(const unsigned char* data, size_t size);
 
 	void IndexedToRgb(const unsigned char* indexed, size_t size,
 		unsigned char* rgb) const;
 
+	// identifies the colors, the same indices decode to the same pixels
+	// only under palettes with the same hash
+	uint64_t GetHash() const;
+
 private:
 	size_t m_size;
 	unsigned char* m_data;
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "quake/Profiler.h"
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace quake
+{
+
+// Splits [0, count) into chunks of at least grain items and calls
+// func(begin, end) for each of them on its own thread, which profiles
+// into the caller's Profiler::Current().
+template <typename Func>
+void ParallelFor(size_t count, size_t grain, Func func)
+{
+	if (count == 0) {
+		return;
+	}
+
+	size_t threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+	threads = std::min(threads, (count + grain - 1) / std::max<size_t>(grain, 1));
+	if (threads <= 1) {
+		func(size_t(0), count);
+		return;
+	}
+
+	const size_t chunk = (count + threads - 1) / threads;
+	Profiler* prof = Profiler::Current();
+
+	std::vector<std::thread> workers;
+	workers.reserve(threads - 1);
+	for (size_t t = 1; t < threads; ++t)
+	{
+		const size_t begin = t * chunk;
+		const size_t end = std::min(count, begin + chunk);
+		if (begin < end) {
+			workers.emplace_back([=, &func]() {
+				ProfileBind bind(prof);
+				func(begin, end);
+			});
+		}
+	}
+	func(size_t(0), std::min(count, chunk));
+
+	for (auto& w : workers) {
+		w.join();
+	}
+}
+
+}
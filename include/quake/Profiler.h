@@ -0,0 +1,215 @@
+#pragma once
+
+// QUAKE_NO_PROFILE compiles all the profile macros out
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+namespace ProfileCounter
+{
+	enum Type
+	{
+		Tokens = 0,
+		Entities,
+		Brushes,
+		Faces,
+		Textures,
+		BytesDecoded,
+		BytesUploaded,
+		Allocations,
+		LightmapBlocks,
+		BlocksCompressed,
+
+		MaxCount
+	};
+
+	const char* Name(Type type);
+}
+
+// accumulates many short scopes without emitting a trace event for each.
+// kept as a plain member whether QUAKE_NO_PROFILE is defined or not, so the
+// layout of the classes holding one doesn't depend on it
+struct ProfileTimer
+{
+	uint64_t total_ns = 0;
+	uint64_t count    = 0;
+};
+
+class Profiler
+{
+public:
+	struct Phase
+	{
+		std::string name;
+		uint64_t    count    = 0;
+		double      total_ms = 0;
+	};
+
+	struct Summary
+	{
+		std::vector<Phase> phases;
+		uint64_t counters[ProfileCounter::MaxCount];
+		// trace events past the cap, still counted in the phases
+		uint64_t dropped_events = 0;
+	};
+
+	// events kept for the trace, 32 bytes each
+	static const size_t DEFAULT_MAX_EVENTS = 1 << 18;
+
+public:
+	Profiler();
+
+	void SetEnabled(bool enable) { m_enabled = enable; }
+	bool IsEnabled() const { return m_enabled; }
+
+	void Clear();
+
+	void SetMaxEvents(size_t max) { m_max_events = max; }
+
+	uint64_t NowNS() const;
+
+	void AddEvent(const char* name, uint64_t begin_ns, uint64_t end_ns);
+	void AddTimer(const char* name, const ProfileTimer& timer);
+
+	void AddCounter(ProfileCounter::Type type, uint64_t n) {
+		if (m_enabled) {
+			m_counters[type] += n;
+		}
+	}
+
+	Summary GetSummary() const;
+
+	// chrome://tracing or perfetto json
+	std::string ToChromeTrace() const;
+	bool WriteChromeTrace(const std::string& filepath) const;
+
+	// the process wide one, created on first use by any thread
+	static Profiler* Instance();
+	// what the profile macros record into, the one bound to this thread by
+	// a ProfileBind or else Instance()
+	static Profiler* Current();
+
+private:
+	struct Event
+	{
+		const char* name;
+		uint64_t    begin_ns;
+		uint64_t    dur_ns;
+		uint32_t    tid;
+	};
+
+	void AddPhase(const char* name, uint64_t total_ns, uint64_t count);
+
+	uint32_t ThreadID();
+
+private:
+	std::atomic<bool> m_enabled;
+
+	std::chrono::steady_clock::time_point m_epoch;
+
+	mutable std::mutex m_mtx;
+	std::vector<Event> m_events;
+	size_t   m_max_events;
+	uint64_t m_dropped_events;
+	std::map<std::string, Phase> m_phases;
+	std::map<size_t, uint32_t> m_thread_ids;
+
+	std::atomic<uint64_t> m_counters[ProfileCounter::MaxCount];
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator = (const Profiler&) = delete;
+
+}; // Profiler
+
+// makes prof the Current() one of this thread until the end of the scope,
+// so loads with their own MapContext don't record into each other.
+// ParallelFor and TaskPool hand the submitting thread's on to their tasks
+class ProfileBind
+{
+public:
+	ProfileBind(Profiler* prof);
+	~ProfileBind();
+
+private:
+	Profiler* m_prev;
+
+}; // ProfileBind
+
+class ProfileScope
+{
+public:
+	ProfileScope(const char* name)
+		: m_name(name)
+		, m_begin(Profiler::Current()->IsEnabled() ? Profiler::Current()->NowNS() : 0)
+	{
+	}
+	~ProfileScope()
+	{
+		auto prof = Profiler::Current();
+		if (prof->IsEnabled()) {
+			prof->AddEvent(m_name, m_begin, prof->NowNS());
+		}
+	}
+
+private:
+	const char* m_name;
+	uint64_t    m_begin;
+
+}; // ProfileScope
+
+class ProfileTimerScope
+{
+public:
+	ProfileTimerScope(ProfileTimer& timer)
+		: m_timer(timer)
+		, m_begin(Profiler::Current()->IsEnabled() ? Profiler::Current()->NowNS() : 0)
+	{
+	}
+	~ProfileTimerScope()
+	{
+		auto prof = Profiler::Current();
+		if (prof->IsEnabled()) {
+			m_timer.total_ns += prof->NowNS() - m_begin;
+			++m_timer.count;
+		}
+	}
+
+private:
+	ProfileTimer& m_timer;
+	uint64_t      m_begin;
+
+}; // ProfileTimerScope
+
+}
+
+#define QUAKE_PROFILE_CONCAT_IMPL(a, b) a##b
+#define QUAKE_PROFILE_CONCAT(a, b) QUAKE_PROFILE_CONCAT_IMPL(a, b)
+
+#ifndef QUAKE_NO_PROFILE
+
+#define QUAKE_PROFILE_SCOPE(name) \
+	quake::ProfileScope QUAKE_PROFILE_CONCAT(_profile_scope_, __LINE__)(name)
+#define QUAKE_PROFILE_COUNTER(type, n) \
+	quake::Profiler::Current()->AddCounter(quake::ProfileCounter::type, n)
+#define QUAKE_PROFILE_TIMER_SCOPE(var) \
+	quake::ProfileTimerScope QUAKE_PROFILE_CONCAT(_profile_timer_, __LINE__)(var)
+#define QUAKE_PROFILE_TIMER_FLUSH(var, name) \
+	do { quake::Profiler::Current()->AddTimer(name, var); var = quake::ProfileTimer(); } while (0)
+
+#else
+
+#define QUAKE_PROFILE_SCOPE(name)
+#define QUAKE_PROFILE_COUNTER(type, n)
+#define QUAKE_PROFILE_TIMER_SCOPE(var)
+#define QUAKE_PROFILE_TIMER_FLUSH(var, name) do { } while (0)
+
+#endif // QUAKE_NO_PROFILE
@@ -0,0 +1,13 @@
+#pragma once
+
+// QUAKE_NO_SIMD forces the scalar paths
+
+#if !defined(QUAKE_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define QUAKE_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(QUAKE_SIMD_SSE2) && defined(__AVX2__)
+#define QUAKE_SIMD_AVX2
+#include <immintrin.h>
+#endif
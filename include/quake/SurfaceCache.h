@@ -0,0 +1,100 @@
+#pragma once
+
+#include "quake/WadFileLoader.h"
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+class Palette;
+class Lightmaps;
+
+// Software rendered lit surfaces, as quake's surface cache: the texture's
+// palette indices are relit through a 64 level light table with the
+// bilinearly filtered lightmap, the result is still palette indices.
+// Built surfaces are kept per face and mip until their light version
+// changes or they are evicted as the least recently used.
+class SurfaceCache
+{
+public:
+	struct Surface
+	{
+		const WadFileLoader::IndexedTexture* texture = nullptr;
+
+		// texture space rect of the face at mip 0, as the lightmap's
+		int texture_mins[2] = { 0, 0 };
+		int extents[2] = { 0, 0 };
+
+		// luxels are (extents >> 4) + 1 on each side, at light_s, light_t
+		// of the lightmap block, no block is fullbright
+		int lightmap = -1;
+		int light_s = 0, light_t = 0;
+
+		// bump when the luxels change, eg. light styles
+		uint32_t light_version = 0;
+	};
+
+	struct Entry
+	{
+		int width = 0, height = 0;
+		std::vector<uint8_t> pixels;
+
+		uint32_t face = 0;
+		int      mip = 0;
+		uint32_t light_version = 0;
+	};
+
+	struct Stats
+	{
+		size_t hits = 0;
+		size_t misses = 0;
+		size_t evictions = 0;
+		size_t bytes = 0;
+	};
+
+public:
+	// the light table is built from palette, budget caps the cached pixels
+	SurfaceCache(const Palette& palette, const Lightmaps& lightmaps,
+		size_t budget_bytes = 8 << 20);
+
+	// the entry stays valid until the next Get() or Clear()
+	const Entry* Get(uint32_t face, int mip, const Surface& surface);
+
+	void Clear();
+
+	auto& GetStats() const { return m_stats; }
+
+	// 64 rows of 256 indices, row 0 is twice as bright as the texture,
+	// row 32 the texture itself. indices from 224 are fullbright
+	auto& GetLightTable() const { return m_light_table; }
+
+	static const int LIGHT_LEVELS = 64;
+
+private:
+	void BuildLightTable(const Palette& palette);
+
+	void Build(const Surface& surface, int mip, Entry& entry) const;
+
+	void Evict();
+
+private:
+	const Lightmaps& m_lightmaps;
+
+	size_t m_budget;
+
+	std::vector<uint8_t> m_light_table;
+
+	// front is the most recently used
+	std::list<Entry> m_lru;
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> m_entries;
+
+	Stats m_stats;
+
+}; // SurfaceCache
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+// Quake 2 brush contents and surface flags, the values of its qfiles.h.
+// Quake 1 maps have neither, GetTextureSurface() derives them from the
+// texture naming conventions.
+namespace ContentFlags
+{
+	enum : uint32_t
+	{
+		Solid       = 0x1,
+		Window      = 0x2,
+		Lava        = 0x8,
+		Slime       = 0x10,
+		Water       = 0x20,
+		Mist        = 0x40,
+		PlayerClip  = 0x10000,
+		MonsterClip = 0x20000,
+		Origin      = 0x1000000,
+		Detail      = 0x8000000,
+		Translucent = 0x10000000,
+		Trigger     = 0x40000000,
+
+		// brushes whose faces are never drawn
+		Invisible   = PlayerClip | MonsterClip | Origin | Trigger,
+	};
+}
+
+namespace SurfaceFlags
+{
+	enum : uint32_t
+	{
+		Light   = 0x1,
+		Slick   = 0x2,
+		Sky     = 0x4,
+		Warp    = 0x8,
+		Trans33 = 0x10,
+		Trans66 = 0x20,
+		Flowing = 0x40,
+		NoDraw  = 0x80,
+		Hint    = 0x100,
+		Skip    = 0x200,
+
+		Invisible = NoDraw | Hint | Skip,
+	};
+}
+
+struct FaceSurface
+{
+	uint32_t contents = ContentFlags::Solid;
+	uint32_t flags    = 0;
+	int32_t  value    = 0;
+
+	bool IsDrawn() const {
+		return (contents & ContentFlags::Invisible) == 0 && (flags & SurfaceFlags::Invisible) == 0;
+	}
+};
+
+// what a texture name implies in quake 1, eg. "clip", "trigger", "skip",
+// "sky4" or "*lava1". a path as quake 2 uses is matched by its last part
+FaceSurface GetTextureSurface(const std::string& tex_name);
+
+}
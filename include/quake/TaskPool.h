@@ -0,0 +1,58 @@
+#pragma once
+
+#include "quake/Profiler.h"
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+
+namespace quake
+{
+
+class TaskPool
+{
+public:
+	// 0 uses one thread per core
+	TaskPool(size_t threads = 0);
+	~TaskPool();
+
+	// the task profiles into the submitting thread's Profiler::Current()
+	template <typename Func>
+	auto Submit(Func func) -> std::future<decltype(func())>
+	{
+		typedef decltype(func()) Ret;
+		auto task = std::make_shared<std::packaged_task<Ret()>>(std::move(func));
+		auto future = task->get_future();
+		Profiler* prof = Profiler::Current();
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_tasks.push([task, prof]() {
+				ProfileBind bind(prof);
+				(*task)();
+			});
+		}
+		m_cv.notify_one();
+		return future;
+	}
+
+	size_t GetThreadNum() const { return m_workers.size(); }
+
+private:
+	void WorkerLoop();
+
+private:
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	std::queue<std::function<void()>> m_tasks;
+	bool m_stop = false;
+
+}; // TaskPool
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <unirender/TextureFormat.h>
+
+#include <vector>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+// Block compression of decoded textures: BC1 (DXT1) stores 4x4 texels of
+// rgb in 8 bytes, BC3 (DXT5) adds 8 bytes of alpha. Rows of blocks are
+// compressed in parallel, texels are matched to the block's colors 4 at a
+// time with SSE2.
+class TextureCompressor
+{
+public:
+	enum class Format
+	{
+		BC1,
+		BC3,
+	};
+
+	enum class Quality
+	{
+		Fast,     // endpoints from the bounding box
+		Normal,   // endpoints along the principal axis
+		High,     // and refined by least squares
+	};
+
+	struct Params
+	{
+		Format  format  = Format::BC1;
+		Quality quality = Quality::Normal;
+
+		// also compress the smaller levels stored in the wad
+		bool mips = true;
+	};
+
+	struct Level
+	{
+		uint32_t width  = 0;
+		uint32_t height = 0;
+		std::vector<uint8_t> data;
+	};
+
+	struct Image
+	{
+		Format format = Format::BC1;
+		// level 0 is the full size
+		std::vector<Level> levels;
+	};
+
+public:
+	// pixels are width * height texels of 3 (rgb) or 4 (rgba) channels,
+	// out takes CompressedSize() bytes
+	static void Compress(const uint8_t* pixels, int channels, uint32_t width, uint32_t height,
+		Format format, Quality quality, uint8_t* out);
+
+	static size_t CompressedSize(Format format, uint32_t width, uint32_t height);
+
+	static ur::TextureFormat ToTextureFormat(Format format);
+
+}; // TextureCompressor
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "quake/TextureCompressor.h"
+
+#include <string>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+// Compressed textures on disk, one file per content hash and compression
+// settings, so loading the same wads again skips the encoding. Load and
+// Store can be called from any thread.
+class TextureDiskCache
+{
+public:
+	// dir is created if missing
+	TextureDiskCache(const std::string& dir);
+
+	bool Load(uint64_t hash, const TextureCompressor::Params& params,
+		TextureCompressor::Image& image) const;
+	bool Store(uint64_t hash, const TextureCompressor::Params& params,
+		const TextureCompressor::Image& image) const;
+
+	auto& GetDir() const { return m_dir; }
+
+private:
+	std::string FilePath(uint64_t hash, const TextureCompressor::Params& params) const;
+
+private:
+	std::string m_dir;
+
+}; // TextureDiskCache
+
+}
@@ -1,25 +1,75 @@
 #pragma once
 
-#include <cu/cu_macro.h>
 #include <unirender/typedef.h>
 
+#include <string>
 #include <map>
+#include <unordered_map>
 #include <memory>
 
+#include <stdint.h>
+
 namespace quake
 {
 
 class TextureManager
 {
 public:
+	TextureManager();
+
 	void Add(const std::string& name, ur::TexturePtr& tex);
 
     ur::TexturePtr Query(const std::string& name) const;
 
+	// content addressed, hash covers the pixels and the palette they were
+	// decoded with, so identical textures from different wads share one upload.
+	// bytes is the size uploaded, 0 to estimate it as rgb. tex is null when
+	// uploaded headless, the size and bytes are kept for it all the same
+	void Add(const std::string& name, ur::TexturePtr& tex, uint64_t hash,
+		int width, int height, size_t bytes = 0);
+	ur::TexturePtr QueryByHash(uint64_t hash) const;
+
+	// registers name for the texture already added with hash, bytes is what
+	// uploading it again would have cost. false if hash is unknown
+	bool AddShared(const std::string& name, uint64_t hash, size_t bytes);
+
+	// a smaller level standing in for a width x height texture until
+	// Upgrade() swaps in a larger one, see TextureStreamer
+	void AddPartial(const std::string& name, ur::TexturePtr& tex, int width, int height);
+	bool Upgrade(const std::string& name, ur::TexturePtr& tex);
+
+	// the full size for partial textures, what texture coordinates are built for
+	bool QuerySize(const std::string& name, int& width, int& height) const;
+
+	struct ShareStats
+	{
+		size_t textures    = 0;     // names that reused an upload
+		size_t bytes_saved = 0;
+	};
+	auto& GetShareStats() const { return m_share_stats; }
+
+	// estimated device memory of the distinct textures, and what the
+	// registry itself takes
+	size_t GetDeviceBytes() const;
+	size_t GetHostBytes() const;
+
+	// the default MapContext's
+	static TextureManager* Instance();
+
 private:
 	std::map<std::string, ur::TexturePtr> m_name2tex;
 
-	CU_SINGLETON_DECLARATION(TextureManager);
+	struct Upload
+	{
+		ur::TexturePtr tex;
+		int    width, height;
+		size_t bytes;
+	};
+	std::unordered_map<uint64_t, Upload> m_hash2tex;
+
+	// of the textures added with a hash or as partial ones
+	std::unordered_map<std::string, std::pair<int, int>> m_sizes;
+	ShareStats m_share_stats;
 
 }; // TextureManager
 
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "quake/WadFileLoader.h"
+#include "quake/MapContext.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+namespace quake
+{
+
+class TaskPool;
+class Palette;
+class TextureUploader;
+
+// Progressive wad loading. AddWad() registers every texture at the smallest
+// level the wad stores, 1/64 of the pixels, so a map can be drawn at once.
+// The larger levels are decoded on the task pool and swapped in one level
+// at a time from Update(), the textures with the highest priority first.
+class TextureStreamer
+{
+public:
+	TextureStreamer(TaskPool& pool, const Palette& palette,
+		MapContext& ctx = MapContext::Default());
+	~TextureStreamer();
+
+	// render thread. names already in the context's TextureManager are skipped
+	void AddWad(TextureUploader& uploader, const unsigned char* data, size_t size);
+
+	// render thread, higher first, eg. how many visible faces use the texture
+	void SetPriority(const std::string& name, float priority);
+
+	// render thread, uploads decoded levels until budget_ms is spent and
+	// starts decoding the next ones. returns the textures not at level 0 yet
+	size_t Update(TextureUploader& uploader, double budget_ms);
+
+	// the level each texture is drawn with, -1 if unknown
+	int GetLevel(const std::string& name) const;
+
+	void Cancel();
+
+private:
+	struct Entry
+	{
+		std::string name;
+		uint32_t    width;
+		uint32_t    height;
+
+		// indexed pixels, freed once a level and those below it are uploaded
+		std::vector<unsigned char> mips[WadFileLoader::MIP_LEVELS];
+
+		int   level;
+		bool  decoding = false;
+		float priority = 0;
+	};
+
+	struct Decoded
+	{
+		size_t entry;
+		int    level;
+		std::vector<unsigned char> rgb;
+	};
+
+private:
+	void DecodeTask(const Entry& e, size_t entry, int level);
+
+	void SubmitDecodes();
+
+	void WaitAll();
+
+private:
+	TaskPool&      m_pool;
+	const Palette& m_palette;
+	MapContext&    m_ctx;
+
+	// a deque so the decode tasks' references survive AddWad()
+	std::deque<Entry> m_entries;
+	std::unordered_map<std::string, size_t> m_name2entry;
+	size_t m_decoding = 0;
+
+	std::mutex m_mtx;
+	std::vector<Decoded> m_decoded;
+
+	std::vector<std::future<void>> m_futures;
+	std::atomic<bool> m_cancel;
+
+}; // TextureStreamer
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <unirender/typedef.h>
+#include <unirender/Device.h>
+
+#include <vector>
+#include <mutex>
+
+#include <stdint.h>
+
+namespace quake
+{
+
+// Where the loaders send their pixels. Every upload is counted and timed,
+// so the load path can be measured with or without a gpu.
+class TextureUploader
+{
+public:
+	struct Record
+	{
+		size_t   width;
+		size_t   height;
+		ur::TextureFormat format;
+		size_t   bytes;
+		uint64_t time_ns;
+	};
+
+	struct Stats
+	{
+		size_t   count   = 0;
+		uint64_t bytes   = 0;
+		uint64_t time_ns = 0;
+	};
+
+public:
+	virtual ~TextureUploader() {}
+
+	ur::TexturePtr CreateTexture(size_t width, size_t height, ur::TextureFormat format,
+		const void* pixels, size_t size);
+
+	Stats GetStats() const;
+	std::vector<Record> GetRecords() const;
+
+	void ResetStats();
+
+protected:
+	virtual ur::TexturePtr OnCreateTexture(size_t width, size_t height,
+		ur::TextureFormat format, const void* pixels, size_t size) = 0;
+
+private:
+	mutable std::mutex m_mtx;
+
+	Stats m_stats;
+	std::vector<Record> m_records;
+
+}; // TextureUploader
+
+class DeviceTextureUploader : public TextureUploader
+{
+public:
+	DeviceTextureUploader(const ur::Device& dev) : m_dev(dev) {}
+
+protected:
+	virtual ur::TexturePtr OnCreateTexture(size_t width, size_t height,
+		ur::TextureFormat format, const void* pixels, size_t size) override;
+
+private:
+	const ur::Device& m_dev;
+
+}; // DeviceTextureUploader
+
+}
@@ -1,6 +1,14 @@
 #pragma once
 
+#include "quake/MapContext.h"
+#include "quake/TextureCompressor.h"
+
 #include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+
+#include <stdint.h>
 
 namespace ur { class Device; }
 
@@ -8,20 +16,78 @@ namespace quake
 {
 
 class Palette;
+class TextureUploader;
+class TextureDiskCache;
 
 class WadFileLoader
 {
 public:
-	WadFileLoader(const Palette& palette);
+	WadFileLoader(const Palette& palette, MapContext& ctx = MapContext::Default());
+
+	// textures are uploaded block compressed instead of rgb, encoded ones
+	// are looked up in and added to cache if given
+	void EnableCompression(const TextureCompressor::Params& params,
+		const TextureDiskCache* cache = nullptr);
 
 	void Load(const ur::Device& dev,
         const std::string& wad_filepath);
+	void Load(const ur::Device& dev,
+		const unsigned char* data, size_t size);
+	void Load(TextureUploader& uploader,
+		const unsigned char* data, size_t size);
+
+	struct DecodedTexture
+	{
+		std::string name;
+		uint32_t    width;
+		uint32_t    height;
+		uint64_t    hash;   // see TextureManager::Add
+		std::vector<unsigned char> rgb;
+		// instead of rgb when compression is enabled
+		TextureCompressor::Image compressed;
+
+		// no pixels, shared with a copy decoded elsewhere
+		bool Empty() const { return rgb.empty() && compressed.levels.empty(); }
+		size_t Bytes() const {
+			return compressed.levels.empty() ? rgb.size() : compressed.levels[0].data.size();
+		}
+	};
+
+	static const int MIP_LEVELS = 4;
+
+	// palette indices as stored, for software rendering
+	struct IndexedTexture
+	{
+		std::string name;
+		uint32_t    width;
+		uint32_t    height;
+		// level i is (width >> i) x (height >> i), empty if the wad lacks it
+		std::vector<unsigned char> mips[MIP_LEVELS];
+	};
+	bool LoadIndexed(const unsigned char* data, size_t size,
+		std::vector<IndexedTexture>& textures) const;
+
+	// the texture names only, nothing is decoded
+	static bool LoadNames(const unsigned char* data, size_t size,
+		std::vector<std::string>& names);
+
+	// cpu part of Load, can run on any thread, the textures are uploaded later.
+	// when need_pixels returns false for a hash the texture comes back with
+	// empty rgb, to be shared with the copy decoded elsewhere
+	bool Decode(const unsigned char* data, size_t size, std::vector<DecodedTexture>& textures,
+		const std::atomic<bool>* cancel = nullptr,
+		const std::function<bool(uint64_t hash)>& need_pixels = nullptr) const;
 
 private:
 	static std::string LoadString(const char* data, int len);
 
 private:
 	const Palette& m_palette;
+	MapContext&    m_ctx;
+
+	bool m_compress = false;
+	TextureCompressor::Params m_compress_params;
+	const TextureDiskCache*   m_disk_cache = nullptr;
 
 }; // WadFileLoader
 
@@ -0,0 +1,53 @@
+#include "quake/MapCorpusScanner.h"
+
+#include <iostream>
+#include <string>
+
+#include <string.h>
+
+// quake-scan dir [-wad dir]... [-json file] [-csv file] [-flat] [-threads n]
+int main(int argc, char* argv[])
+{
+	quake::MapCorpusScanner::Params params;
+	std::string json, csv;
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool has_val = i + 1 < argc;
+		if (strcmp(argv[i], "-wad") == 0 && has_val) {
+			params.wad_dirs.push_back(argv[++i]);
+		} else if (strcmp(argv[i], "-json") == 0 && has_val) {
+			json = argv[++i];
+		} else if (strcmp(argv[i], "-csv") == 0 && has_val) {
+			csv = argv[++i];
+		} else if (strcmp(argv[i], "-threads") == 0 && has_val) {
+			params.threads = static_cast<size_t>(std::stoul(argv[++i]));
+		} else if (strcmp(argv[i], "-flat") == 0) {
+			params.recursive = false;
+		} else if (argv[i][0] != '-' && params.dir.empty()) {
+			params.dir = argv[i];
+		} else {
+			params.dir.clear();
+			break;
+		}
+	}
+	if (params.dir.empty())
+	{
+		std::cerr << "usage: quake-scan dir [-wad dir]... [-json file] [-csv file] [-flat] [-threads n]\n";
+		return 1;
+	}
+
+	auto result = quake::MapCorpusScanner::Scan(params);
+	std::cout << result.maps.size() << " maps, " << result.failed << " failed, "
+	          << result.textures.size() << " textures, " << result.unresolved.size() << " unresolved, "
+	          << result.wads.size() << " wads in " << result.seconds << "s\n";
+
+	if (!json.empty() && !quake::MapCorpusScanner::WriteJson(result, json)) {
+		std::cerr << "can't write " << json << "\n";
+		return 1;
+	}
+	if (!csv.empty() && !quake::MapCorpusScanner::WriteCsv(result, csv)) {
+		std::cerr << "can't write " << csv << "\n";
+		return 1;
+	}
+	return 0;
+}
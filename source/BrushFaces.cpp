@@ -0,0 +1,171 @@
+#include "quake/BrushFaces.h"
+
+#include <algorithm>
+
+#include <math.h>
+#include <float.h>
+
+namespace
+{
+
+const float ON_PLANE_EPSILON = 0.01f;
+
+// the parser swaps y and z when reading points
+sm::vec3 ToQuakeSpace(const sm::vec3& v)
+{
+	return sm::vec3(v.x, v.z, v.y);
+}
+
+const float BASE_AXIS[18][3] =
+{
+	{ 0, 0, 1}, {1, 0, 0}, {0,-1, 0},  // floor
+	{ 0, 0,-1}, {1, 0, 0}, {0,-1, 0},  // ceiling
+	{ 1, 0, 0}, {0, 1, 0}, {0, 0,-1},  // west wall
+	{-1, 0, 0}, {0, 1, 0}, {0, 0,-1},  // east wall
+	{ 0, 1, 0}, {1, 0, 0}, {0, 0,-1},  // south wall
+	{ 0,-1, 0}, {1, 0, 0}, {0, 0,-1},  // north wall
+};
+
+}
+
+namespace quake
+{
+
+void BuildBrushFaces(const pm3::Polytope& brush, std::vector<BrushFace>& faces,
+	                 const FaceSurface* surfaces)
+{
+	auto& points = brush.Points();
+	if (points.empty()) {
+		return;
+	}
+
+	sm::vec3 center;
+	for (auto& p : points) {
+		center += p->pos;
+	}
+	center *= 1.0f / points.size();
+
+	auto& brush_faces = brush.Faces();
+	for (size_t i = 0, n = brush_faces.size(); i < n; ++i)
+	{
+		auto& f = brush_faces[i];
+
+		BrushFace dst;
+		dst.face = f.get();
+		dst.index = static_cast<uint32_t>(i);
+		dst.surface = surfaces ? surfaces[i] : GetTextureSurface(f->tex_map.tex_name);
+
+		dst.normal = f->plane.normal;
+		if (f->plane.GetDistance(center) > 0) {
+			dst.normal = -dst.normal;
+		}
+		dst.dist = -FLT_MAX;
+		for (auto& p : points) {
+			dst.dist = std::max(dst.dist, dst.normal.Dot(p->pos));
+		}
+
+		for (auto& p : points)
+		{
+			if (fabsf(dst.normal.Dot(p->pos) - dst.dist) > ON_PLANE_EPSILON) {
+				continue;
+			}
+			bool dup = false;
+			for (auto& v : dst.vertices) {
+				if ((v - p->pos).LengthSquared() < ON_PLANE_EPSILON * ON_PLANE_EPSILON) {
+					dup = true;
+					break;
+				}
+			}
+			if (!dup) {
+				dst.vertices.push_back(p->pos);
+			}
+		}
+		if (dst.vertices.size() < 3) {
+			continue;
+		}
+
+		// sort by angle around the face center
+		sm::vec3 face_center;
+		for (auto& v : dst.vertices) {
+			face_center += v;
+		}
+		face_center *= 1.0f / dst.vertices.size();
+
+		const sm::vec3 u = (dst.vertices[0] - face_center).Normalized();
+		const sm::vec3 v = dst.normal.Cross(u);
+		std::vector<std::pair<float, sm::vec3>> sorted;
+		sorted.reserve(dst.vertices.size());
+		for (auto& p : dst.vertices) {
+			const sm::vec3 d = p - face_center;
+			sorted.push_back({ atan2f(d.Dot(v), d.Dot(u)), p });
+		}
+		std::sort(sorted.begin(), sorted.end(), [](const std::pair<float, sm::vec3>& a, const std::pair<float, sm::vec3>& b) {
+			return a.first < b.first;
+		});
+		for (size_t i = 0, n = sorted.size(); i < n; ++i) {
+			dst.vertices[i] = sorted[i].second;
+		}
+
+		faces.push_back(dst);
+	}
+}
+
+void CalcTextureAxis(const sm::vec3& normal, float angle, const sm::vec2& scale,
+	                 sm::vec3& s_axis, sm::vec3& t_axis)
+{
+	const sm::vec3 n = ToQuakeSpace(normal);
+
+	int best_axis = 0;
+	float best = 0;
+	for (int i = 0; i < 6; ++i)
+	{
+		const float d = n.x * BASE_AXIS[i * 3][0] + n.y * BASE_AXIS[i * 3][1] + n.z * BASE_AXIS[i * 3][2];
+		if (d > best) {
+			best = d;
+			best_axis = i;
+		}
+	}
+
+	float vecs[2][3];
+	for (int i = 0; i < 2; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			vecs[i][j] = BASE_AXIS[best_axis * 3 + 1 + i][j];
+		}
+	}
+
+	// rotate
+	float sinv, cosv;
+	if (angle == 0) {
+		sinv = 0; cosv = 1;
+	} else if (angle == 90) {
+		sinv = 1; cosv = 0;
+	} else if (angle == 180) {
+		sinv = 0; cosv = -1;
+	} else if (angle == 270) {
+		sinv = -1; cosv = 0;
+	} else {
+		const float rad = angle / 180.0f * 3.14159265f;
+		sinv = sinf(rad);
+		cosv = cosf(rad);
+	}
+
+	const int sv = vecs[0][0] ? 0 : (vecs[0][1] ? 1 : 2);
+	const int tv = vecs[1][0] ? 0 : (vecs[1][1] ? 1 : 2);
+	for (int i = 0; i < 2; ++i)
+	{
+		const float ns = cosv * vecs[i][sv] - sinv * vecs[i][tv];
+		const float nt = sinv * vecs[i][sv] + cosv * vecs[i][tv];
+		vecs[i][sv] = ns;
+		vecs[i][tv] = nt;
+	}
+
+	// scale
+	const float sx = scale.x != 0 ? scale.x : 1;
+	const float sy = scale.y != 0 ? scale.y : 1;
+
+	// back to parser space
+	s_axis = ToQuakeSpace(sm::vec3(vecs[0][0], vecs[0][1], vecs[0][2]) * (1.0f / sx));
+	t_axis = ToQuakeSpace(sm::vec3(vecs[1][0], vecs[1][1], vecs[1][2]) * (1.0f / sy));
+}
+
+}
@@ -0,0 +1,36 @@
+#include "quake/HeadlessTextureUploader.h"
+
+namespace quake
+{
+
+HeadlessTextureUploader::HeadlessTextureUploader(bool keep_pixels)
+	: m_keep_pixels(keep_pixels)
+{
+}
+
+void HeadlessTextureUploader::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_textures.clear();
+	ResetStats();
+}
+
+ur::TexturePtr HeadlessTextureUploader::OnCreateTexture(size_t width, size_t height,
+	                                                    ur::TextureFormat format, const void* pixels, size_t size)
+{
+	HostTexture tex;
+	tex.width  = width;
+	tex.height = height;
+	tex.format = format;
+	if (m_keep_pixels && pixels) {
+		auto src = static_cast<const unsigned char*>(pixels);
+		tex.pixels.assign(src, src + size);
+	}
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_textures.push_back(std::move(tex));
+
+	return nullptr;
+}
+
+}
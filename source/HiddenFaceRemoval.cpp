@@ -0,0 +1,315 @@
+#include "quake/HiddenFaceRemoval.h"
+#include "quake/ParallelFor.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+
+#include <math.h>
+#include <float.h>
+
+namespace
+{
+
+const float PLANE_EPSILON  = 0.01f;
+const float NORMAL_EPSILON = 0.0001f;
+
+const float CELL_SIZE = 256.0f;
+
+struct BrushBounds
+{
+	sm::vec3 min, max;
+};
+
+typedef std::vector<sm::vec3> Polygon;
+
+// back is the part with normal.Dot(p) <= dist
+void SplitPolygon(const Polygon& poly, const sm::vec3& normal, float dist,
+	              Polygon& front, Polygon& back)
+{
+	front.clear();
+	back.clear();
+
+	const size_t n = poly.size();
+	std::vector<float> dists(n);
+	bool has_front = false, has_back = false;
+	for (size_t i = 0; i < n; ++i)
+	{
+		dists[i] = normal.Dot(poly[i]) - dist;
+		if (dists[i] > PLANE_EPSILON) {
+			has_front = true;
+		} else if (dists[i] < -PLANE_EPSILON) {
+			has_back = true;
+		}
+	}
+	if (!has_front) {
+		back = poly;
+		return;
+	}
+	if (!has_back) {
+		front = poly;
+		return;
+	}
+
+	for (size_t i = 0; i < n; ++i)
+	{
+		auto& p0 = poly[i];
+		auto& p1 = poly[(i + 1) % n];
+		const float d0 = dists[i];
+		const float d1 = dists[(i + 1) % n];
+
+		if (d0 >= -PLANE_EPSILON) {
+			front.push_back(p0);
+		}
+		if (d0 <= PLANE_EPSILON) {
+			back.push_back(p0);
+		}
+		if ((d0 > PLANE_EPSILON && d1 < -PLANE_EPSILON) ||
+			(d0 < -PLANE_EPSILON && d1 > PLANE_EPSILON))
+		{
+			const sm::vec3 mid = p0 + (p1 - p0) * (d0 / (d0 - d1));
+			front.push_back(mid);
+			back.push_back(mid);
+		}
+	}
+
+	if (front.size() < 3) {
+		front.clear();
+	}
+	if (back.size() < 3) {
+		back.clear();
+	}
+}
+
+// every face drawn and nothing seen through them, liquids and translucent
+// or alpha tested ('{' textures) brushes hide nothing
+bool IsOccluder(const std::vector<quake::BrushFace>& faces)
+{
+	using namespace quake;
+
+	const uint32_t see_through_contents = ContentFlags::Water | ContentFlags::Slime | ContentFlags::Lava
+		| ContentFlags::Window | ContentFlags::Mist | ContentFlags::Translucent;
+	const uint32_t see_through_flags = SurfaceFlags::Trans33 | SurfaceFlags::Trans66;
+	for (auto& f : faces)
+	{
+		if (!f.surface.IsDrawn() || (f.surface.contents & see_through_contents) || (f.surface.flags & see_through_flags)) {
+			return false;
+		}
+
+		auto& name = f.face->tex_map.tex_name;
+		auto slash = name.find_last_of('/');
+		if (name[slash == std::string::npos ? 0 : slash + 1] == '{') {
+			return false;
+		}
+	}
+	return !faces.empty();
+}
+
+int64_t CellKey(int x, int y, int z)
+{
+	return (static_cast<int64_t>(x & 0x1fffff) << 42) |
+		   (static_cast<int64_t>(y & 0x1fffff) << 21) |
+		    static_cast<int64_t>(z & 0x1fffff);
+}
+
+int CellCoord(float v)
+{
+	return static_cast<int>(floorf(v / CELL_SIZE));
+}
+
+}
+
+namespace quake
+{
+
+HiddenFaceRemoval::Stats HiddenFaceRemoval::Run(const std::vector<int>& groups,
+	                                            std::vector<std::vector<BrushFace>>& faces)
+{
+	Stats stats;
+
+	const size_t num = faces.size();
+	std::vector<BrushBounds> bounds(num);
+	std::vector<bool> occluder(num);
+	for (size_t i = 0; i < num; ++i)
+	{
+		auto& b = bounds[i];
+		b.min = sm::vec3( FLT_MAX,  FLT_MAX,  FLT_MAX);
+		b.max = sm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (auto& f : faces[i])
+		{
+			for (auto& v : f.vertices) {
+				for (int k = 0; k < 3; ++k) {
+					b.min[k] = std::min(b.min[k], v[k]);
+					b.max[k] = std::max(b.max[k], v[k]);
+				}
+			}
+		}
+		occluder[i] = IsOccluder(faces[i]);
+		stats.faces_in += faces[i].size();
+	}
+
+	// uniform grid, brushes are registered in every cell they touch and
+	// owned by the cell of their min corner
+	std::unordered_map<int64_t, std::vector<uint32_t>> grid;
+	std::unordered_map<int64_t, std::vector<uint32_t>> owned;
+	for (size_t i = 0; i < num; ++i)
+	{
+		if (faces[i].empty()) {
+			continue;
+		}
+		auto& b = bounds[i];
+		const int x0 = CellCoord(b.min.x - PLANE_EPSILON), x1 = CellCoord(b.max.x + PLANE_EPSILON);
+		const int y0 = CellCoord(b.min.y - PLANE_EPSILON), y1 = CellCoord(b.max.y + PLANE_EPSILON);
+		const int z0 = CellCoord(b.min.z - PLANE_EPSILON), z1 = CellCoord(b.max.z + PLANE_EPSILON);
+		if (occluder[i]) {
+			for (int x = x0; x <= x1; ++x) {
+				for (int y = y0; y <= y1; ++y) {
+					for (int z = z0; z <= z1; ++z) {
+						grid[CellKey(x, y, z)].push_back(static_cast<uint32_t>(i));
+					}
+				}
+			}
+		}
+		owned[CellKey(CellCoord(b.min.x), CellCoord(b.min.y), CellCoord(b.min.z))].push_back(static_cast<uint32_t>(i));
+	}
+
+	std::vector<const std::vector<uint32_t>*> cells;
+	cells.reserve(owned.size());
+	for (auto& itr : owned) {
+		cells.push_back(&itr.second);
+	}
+
+	std::vector<std::vector<BrushFace>> results(num);
+	std::atomic<size_t> removed(0), trimmed(0);
+	ParallelFor(cells.size(), 4, [&](size_t begin, size_t end)
+	{
+		std::vector<uint32_t> neighbors;
+		std::vector<Polygon> fragments, next;
+		Polygon front, back;
+		for (size_t c = begin; c < end; ++c)
+		{
+			for (auto brush : *cells[c])
+			{
+				auto& b = bounds[brush];
+
+				neighbors.clear();
+				const int x0 = CellCoord(b.min.x - PLANE_EPSILON), x1 = CellCoord(b.max.x + PLANE_EPSILON);
+				const int y0 = CellCoord(b.min.y - PLANE_EPSILON), y1 = CellCoord(b.max.y + PLANE_EPSILON);
+				const int z0 = CellCoord(b.min.z - PLANE_EPSILON), z1 = CellCoord(b.max.z + PLANE_EPSILON);
+				for (int x = x0; x <= x1; ++x) {
+					for (int y = y0; y <= y1; ++y) {
+						for (int z = z0; z <= z1; ++z)
+						{
+							auto itr = grid.find(CellKey(x, y, z));
+							if (itr == grid.end()) {
+								continue;
+							}
+							for (auto o : itr->second)
+							{
+								if (o == brush || groups[o] != groups[brush]) {
+									continue;
+								}
+								auto& ob = bounds[o];
+								if (ob.min.x > b.max.x + PLANE_EPSILON || ob.max.x < b.min.x - PLANE_EPSILON ||
+									ob.min.y > b.max.y + PLANE_EPSILON || ob.max.y < b.min.y - PLANE_EPSILON ||
+									ob.min.z > b.max.z + PLANE_EPSILON || ob.max.z < b.min.z - PLANE_EPSILON) {
+									continue;
+								}
+								neighbors.push_back(o);
+							}
+						}
+					}
+				}
+				std::sort(neighbors.begin(), neighbors.end());
+				neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+
+				auto& dst = results[brush];
+				for (auto& face : faces[brush])
+				{
+					fragments.assign(1, face.vertices);
+					bool covered = false;
+					for (auto o : neighbors)
+					{
+						// pressed against an opposite face, or lying on a coplanar one
+						// facing the same way, where the lower brush index is kept
+						auto& ofaces = faces[o];
+						auto itr = std::find_if(ofaces.begin(), ofaces.end(), [&](const BrushFace& f) {
+							return (f.normal.Dot(face.normal) < -1 + NORMAL_EPSILON && fabsf(f.dist + face.dist) < PLANE_EPSILON)
+								|| (o < brush && f.normal.Dot(face.normal) > 1 - NORMAL_EPSILON && fabsf(f.dist - face.dist) < PLANE_EPSILON);
+						});
+						if (itr == ofaces.end()) {
+							continue;
+						}
+
+						// what lies outside any side plane of the neighbor stays visible
+						next.clear();
+						for (auto& frag : fragments)
+						{
+							const size_t first = next.size();
+							Polygon rest = frag;
+							for (auto& side : ofaces)
+							{
+								if (&side == &*itr) {
+									continue;
+								}
+								SplitPolygon(rest, side.normal, side.dist, front, back);
+								if (!front.empty()) {
+									next.push_back(front);
+								}
+								rest.swap(back);
+								if (rest.empty()) {
+									break;
+								}
+							}
+							if (rest.empty()) {
+								// not touching the neighbor's face, keep it in one piece
+								next.resize(first);
+								next.push_back(frag);
+							} else {
+								covered = true;
+							}
+						}
+						fragments.swap(next);
+						if (fragments.empty()) {
+							break;
+						}
+					}
+
+					if (!covered) {
+						dst.push_back(face);
+						continue;
+					}
+
+					if (fragments.empty()) {
+						++removed;
+					} else {
+						++trimmed;
+					}
+					for (auto& frag : fragments)
+					{
+						BrushFace piece;
+						piece.face    = face.face;
+						piece.index   = face.index;
+						piece.surface = face.surface;
+						piece.normal  = face.normal;
+						piece.dist    = face.dist;
+						piece.vertices.swap(frag);
+						dst.push_back(piece);
+					}
+				}
+			}
+		}
+	});
+
+	faces.swap(results);
+
+	stats.removed = removed;
+	stats.trimmed = trimmed;
+	for (auto& f : faces) {
+		stats.faces_out += f.size();
+	}
+
+	return stats;
+}
+
+}
@@ -1,27 +1,140 @@
 #include "quake/Lightmaps.h"
+#include "quake/TextureUploader.h"
+#include "quake/MapContext.h"
 
 #include <unirender/Texture.h>
 #include <model/TextureLoader.h>
 
+#include <algorithm>
+
 #include <string.h>
+#include <math.h>
+
+namespace
+{
+
+// EXT_texture_shared_exponent
+const int RGB9E5_MANTISSA_BITS = 9;
+const int RGB9E5_EXP_BIAS      = 15;
+const int RGB9E5_MAX_EXP       = 31;
+
+uint32_t PackRGB9E5(const float* rgb)
+{
+	const float max_val = static_cast<float>((1 << RGB9E5_MANTISSA_BITS) - 1) / (1 << RGB9E5_MANTISSA_BITS)
+		* static_cast<float>(1 << (RGB9E5_MAX_EXP - RGB9E5_EXP_BIAS));
+
+	float c[3];
+	for (int i = 0; i < 3; ++i) {
+		c[i] = std::min(std::max(rgb[i], 0.0f), max_val);
+	}
+	const float max_c = std::max(c[0], std::max(c[1], c[2]));
+	if (max_c <= 0) {
+		return 0;
+	}
+
+	int exp;
+	frexpf(max_c, &exp);
+	int shared = std::max(-RGB9E5_EXP_BIAS - 1, exp - 1) + 1 + RGB9E5_EXP_BIAS;
+	float denom = ldexpf(1.0f, shared - RGB9E5_EXP_BIAS - RGB9E5_MANTISSA_BITS);
+	if (static_cast<int>(floorf(max_c / denom + 0.5f)) == (1 << RGB9E5_MANTISSA_BITS)) {
+		denom *= 2;
+		++shared;
+	}
+
+	uint32_t ret = static_cast<uint32_t>(shared) << 27;
+	for (int i = 0; i < 3; ++i) {
+		ret |= static_cast<uint32_t>(floorf(c[i] / denom + 0.5f)) << (i * RGB9E5_MANTISSA_BITS);
+	}
+	return ret;
+}
+
+void UnpackRGB9E5(uint32_t v, float* rgb)
+{
+	const float scale = ldexpf(1.0f, static_cast<int>(v >> 27) - RGB9E5_EXP_BIAS - RGB9E5_MANTISSA_BITS);
+	for (int i = 0; i < 3; ++i) {
+		rgb[i] = static_cast<float>((v >> (i * RGB9E5_MANTISSA_BITS)) & 0x1ff) * scale;
+	}
+}
+
+// finite non negative values only, what RGB9E5 decodes to
+uint16_t FloatToHalf(float f)
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	const int exp = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+	if (exp <= 0) {
+		return 0;
+	}
+	if (exp >= 31) {
+		return 0x7bff;
+	}
+	return static_cast<uint16_t>((exp << 10) | ((bits >> 13) & 0x3ff));
+}
+
+ur::TextureFormat UploadFormat(quake::Lightmaps::Format format)
+{
+	switch (format)
+	{
+	// ur has no swizzle, the shader reads .rrr, see Lightmaps::Format
+	case quake::Lightmaps::Format::R8:
+		return ur::TextureFormat::RED;
+	case quake::Lightmaps::Format::RGB8:
+		return ur::TextureFormat::RGB;
+	case quake::Lightmaps::Format::RGB9E5:
+		return ur::TextureFormat::RGBA16F;
+	default:
+		return ur::TextureFormat::RGBA8;
+	}
+}
+
+}
 
 namespace quake
 {
 
-CU_SINGLETON_DEFINITION(Lightmaps);
+Lightmaps::Lightmaps(Format format)
+	: m_format(format)
+	, m_bpp(BytesPerLuxel(format))
+{
+	Clear();
+}
 
-Lightmaps::Lightmaps()
+void Lightmaps::SetFormat(Format format)
 {
+	m_format = format;
+	m_bpp    = BytesPerLuxel(format);
+	std::vector<uint8_t>().swap(m_lightmaps);
 	Clear();
 }
 
+int Lightmaps::BytesPerLuxel(Format format)
+{
+	switch (format)
+	{
+	case Format::R8:
+		return 1;
+	case Format::RGB8:
+		return 3;
+	default:
+		return 4;
+	}
+}
+
+Lightmaps* Lightmaps::Instance()
+{
+	return &MapContext::Default().GetLightmaps();
+}
+
 int Lightmaps::AllocBlock(int w, int h, int* x, int* y)
 {
+	QUAKE_PROFILE_TIMER_SCOPE(m_alloc_timer);
+
 	// ericw -- rather than searching starting at lightmap 0 every time,
 	// start at the last lightmap we allocated a surface in.
 	// This makes AllocBlock much faster on large levels (can shave off 3+ seconds
 	// of load time on a level with 180 lightmaps), at a cost of not quite packing
 	// lightmaps as tightly vs. not doing this (uses ~5% more lightmaps)
+	const int first = m_last_lightmap_allocated;
 	for (int texnum = m_last_lightmap_allocated; texnum < MAX_LIGHTMAPS; ++texnum, ++m_last_lightmap_allocated)
 	{
 		int best = BLOCK_HEIGHT;
@@ -54,30 +167,189 @@ int Lightmaps::AllocBlock(int w, int h, int* x, int* y)
 			m_allocated[texnum][*x + i] = best + h;
 		}
 
+		const size_t pages = m_lightmaps.size() / GetPageBytes();
+		if (static_cast<size_t>(texnum) >= pages) {
+			m_lightmaps.resize((texnum + 1) * GetPageBytes());
+			FillPages(pages, texnum + 1);
+		}
+
 		return texnum;
 	}
 
-	return 0; //johnfitz -- shut up compiler
+	// too large for any page, or all are full. quake stops with an error
+	// here, smaller blocks can still go where the search started
+	m_last_lightmap_allocated = first;
+	return -1;
 }
 
 uint8_t* Lightmaps::Query(int tex_idx, int x, int y)
 {
-	uint8_t* base = m_lightmaps + tex_idx * BPP * BLOCK_WIDTH * BLOCK_HEIGHT;
-	base += (y * BLOCK_WIDTH + x) * BPP;
+	uint8_t* base = m_lightmaps.data() + tex_idx * GetPageBytes();
+	base += (y * BLOCK_WIDTH + x) * m_bpp;
 	return base;
 }
 
+const uint8_t* Lightmaps::Query(int tex_idx, int x, int y) const
+{
+	const uint8_t* base = m_lightmaps.data() + tex_idx * GetPageBytes();
+	base += (y * BLOCK_WIDTH + x) * m_bpp;
+	return base;
+}
+
+void Lightmaps::SetLuxel(int tex_idx, int x, int y, const float* rgb)
+{
+	auto to_byte = [](float f) {
+		return static_cast<uint8_t>(std::min(std::max(f * 255.0f + 0.5f, 0.0f), 255.0f));
+	};
+
+	uint8_t* p = Query(tex_idx, x, y);
+	switch (m_format)
+	{
+	case Format::R8:
+		p[0] = to_byte((rgb[0] + 2 * rgb[1] + rgb[2]) * 0.25f);
+		break;
+	case Format::RGB8:
+	case Format::RGBA8:
+		for (int i = 0; i < 3; ++i) {
+			p[i] = to_byte(rgb[i]);
+		}
+		if (m_format == Format::RGBA8) {
+			p[3] = 255;
+		}
+		break;
+	case Format::RGB9E5:
+	{
+		const uint32_t v = PackRGB9E5(rgb);
+		memcpy(p, &v, sizeof(v));
+	}
+		break;
+	}
+}
+
+void Lightmaps::GetLuxel(int tex_idx, int x, int y, float* rgb) const
+{
+	const uint8_t* p = Query(tex_idx, x, y);
+	switch (m_format)
+	{
+	case Format::R8:
+		rgb[0] = rgb[1] = rgb[2] = p[0] / 255.0f;
+		break;
+	case Format::RGB8:
+	case Format::RGBA8:
+		for (int i = 0; i < 3; ++i) {
+			rgb[i] = p[i] / 255.0f;
+		}
+		break;
+	case Format::RGB9E5:
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		UnpackRGB9E5(v, rgb);
+	}
+		break;
+	}
+}
+
+int Lightmaps::GetIntensity(int tex_idx, int x, int y) const
+{
+	const uint8_t* p = Query(tex_idx, x, y);
+	switch (m_format)
+	{
+	case Format::R8:
+		return p[0];
+	case Format::RGB9E5:
+	{
+		float rgb[3];
+		GetLuxel(tex_idx, x, y, rgb);
+		const float v = (rgb[0] + 2 * rgb[1] + rgb[2]) * 0.25f * 255.0f + 0.5f;
+		return static_cast<int>(std::min(v, 255.0f));
+	}
+	default:
+		return (p[0] + 2 * p[1] + p[2]) >> 2;
+	}
+}
+
 void Lightmaps::CreatetTextures(const ur::Device& dev)
 {
+	// the loader only knows 8 bit channels
+	if (m_format == Format::RGB9E5) {
+		DeviceTextureUploader uploader(dev);
+		CreatetTextures(uploader);
+		return;
+	}
+
+	QUAKE_PROFILE_SCOPE("Lightmaps::CreatetTextures");
+
+	for (int i = 0; i < MAX_LIGHTMAPS; ++i)
+	{
+		if (!m_allocated[i][0]) {
+			break;
+		}
+
+		auto data = m_lightmaps.data() + i * GetPageBytes();
+		m_textures[i] = model::TextureLoader::LoadFromMemory(dev, data, BLOCK_WIDTH, BLOCK_HEIGHT, m_bpp);
+		m_uploaded_pages = i + 1;
+
+		QUAKE_PROFILE_COUNTER(LightmapBlocks, 1);
+		QUAKE_PROFILE_COUNTER(BytesUploaded, GetPageBytes());
+	}
+
+	FlushProfile();
+}
+
+void Lightmaps::CreatetTextures(TextureUploader& uploader)
+{
+	QUAKE_PROFILE_SCOPE("Lightmaps::CreatetTextures");
+
+	std::vector<uint16_t> half;
 	for (int i = 0; i < MAX_LIGHTMAPS; ++i)
 	{
 		if (!m_allocated[i][0]) {
 			break;
 		}
 
-		auto data = m_lightmaps + i * BLOCK_WIDTH * BLOCK_HEIGHT * BPP;
-		m_textures[i] = model::TextureLoader::LoadFromMemory(dev, data, BLOCK_WIDTH, BLOCK_HEIGHT, BPP);
+		const uint8_t* data = m_lightmaps.data() + i * GetPageBytes();
+		size_t size = GetPageBytes();
+
+		// no shared exponent format to upload to, expanded to half floats
+		if (m_format == Format::RGB9E5)
+		{
+			half.resize(BLOCK_WIDTH * BLOCK_HEIGHT * 4);
+			for (int j = 0; j < BLOCK_WIDTH * BLOCK_HEIGHT; ++j)
+			{
+				uint32_t v;
+				memcpy(&v, data + j * 4, sizeof(v));
+				float rgb[3];
+				UnpackRGB9E5(v, rgb);
+				for (int k = 0; k < 3; ++k) {
+					half[j * 4 + k] = FloatToHalf(rgb[k]);
+				}
+				half[j * 4 + 3] = FloatToHalf(1.0f);
+			}
+			data = reinterpret_cast<const uint8_t*>(half.data());
+			size = half.size() * sizeof(uint16_t);
+		}
+
+		m_textures[i] = uploader.CreateTexture(BLOCK_WIDTH, BLOCK_HEIGHT, UploadFormat(m_format), data, size);
+		m_uploaded_pages = i + 1;
+
+		QUAKE_PROFILE_COUNTER(LightmapBlocks, 1);
+		QUAKE_PROFILE_COUNTER(BytesUploaded, size);
 	}
+
+	FlushProfile();
+}
+
+int Lightmaps::GetUsedPages() const
+{
+	// AllocBlock fills pages in order, the ones after the last are untouched
+	int used = 0;
+	for (int i = 0; i <= m_last_lightmap_allocated && i < MAX_LIGHTMAPS; ++i) {
+		if (std::any_of(m_allocated[i], m_allocated[i] + BLOCK_WIDTH, [](int h) { return h != 0; })) {
+			++used;
+		}
+	}
+	return used;
 }
 
 unsigned int Lightmaps::GetTexID(int idx) const
@@ -89,16 +361,43 @@ unsigned int Lightmaps::GetTexID(int idx) const
 	}
 }
 
+void Lightmaps::FlushProfile()
+{
+	QUAKE_PROFILE_TIMER_FLUSH(m_alloc_timer, "Lightmaps::AllocBlock");
+}
+
 void Lightmaps::Clear()
 {
 	memset(m_allocated, 0, sizeof(m_allocated));
 	m_last_lightmap_allocated = 0;
 
-	memset(m_lightmaps, 0xff, sizeof(m_lightmaps));
+	// the memory is kept for the next map
+	FillPages(0, m_lightmaps.size() / GetPageBytes());
 
 	for (int i = 0; i < MAX_LIGHTMAPS; ++i) {
 		m_textures[i].reset();
 	}
+	m_uploaded_pages = 0;
+}
+
+void Lightmaps::FillPages(size_t begin, size_t end)
+{
+	if (begin >= end) {
+		return;
+	}
+
+	uint8_t* dst = m_lightmaps.data() + begin * GetPageBytes();
+	const size_t size = (end - begin) * GetPageBytes();
+	if (m_format != Format::RGB9E5) {
+		memset(dst, 0xff, size);
+		return;
+	}
+
+	const float white[3] = { 1.0f, 1.0f, 1.0f };
+	const uint32_t v = PackRGB9E5(white);
+	for (size_t i = 0; i < size; i += 4) {
+		memcpy(dst + i, &v, sizeof(v));
+	}
 }
 
-}
\ No newline at end of file
+}
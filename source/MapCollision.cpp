@@ -0,0 +1,416 @@
+#include "quake/MapCollision.h"
+#include "quake/ParallelFor.h"
+#include "quake/SIMD.h"
+#include "quake/Profiler.h"
+
+#include <polymesh3/Polytope.h>
+
+#include <unordered_map>
+#include <algorithm>
+
+namespace
+{
+
+// traces stop this far in front of a plane, as quake 2's DIST_EPSILON
+const float DIST_EPSILON = 0.03125f;
+
+// qbsp's limits for bevel planes
+const float BEVEL_NORMAL_EPSILON = 0.0001f;
+const float BEVEL_DIST_EPSILON   = 0.1f;
+
+struct BevelPlane
+{
+	sm::vec3 normal;
+	float    dist;
+};
+
+bool HasPlane(const std::vector<BevelPlane>& planes, const sm::vec3& normal)
+{
+	for (auto& p : planes) {
+		if (p.normal.Dot(normal) > 1.0f - BEVEL_NORMAL_EPSILON) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// brush planes facing out plus the bevels a box needs to not catch on
+// corners: the axial planes at the bounds and the planes through each
+// edge and an axis that have the whole brush behind them
+void BuildBrushPlanes(const pm3::Polytope& brush, std::vector<BevelPlane>& planes)
+{
+	auto& points = brush.Points();
+
+	sm::vec3 center;
+	for (auto& p : points) {
+		center += p->pos;
+	}
+	center *= 1.0f / points.size();
+
+	auto max_dist = [&points](const sm::vec3& normal) {
+		float d = -FLT_MAX;
+		for (auto& p : points) {
+			d = std::max(d, normal.Dot(p->pos));
+		}
+		return d;
+	};
+
+	for (auto& f : brush.Faces())
+	{
+		sm::vec3 normal = f->plane.normal;
+		if (f->plane.GetDistance(center) > 0) {
+			normal = -normal;
+		}
+		if (!HasPlane(planes, normal)) {
+			planes.push_back({ normal, max_dist(normal) });
+		}
+	}
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		for (int dir = -1; dir <= 1; dir += 2)
+		{
+			sm::vec3 normal(0, 0, 0);
+			normal[axis] = static_cast<float>(dir);
+			if (!HasPlane(planes, normal)) {
+				planes.push_back({ normal, max_dist(normal) });
+			}
+		}
+	}
+
+	for (auto& f : brush.Faces())
+	{
+		auto& loop = f->points;
+		for (size_t i = 0, n = loop.size(); i < n; ++i)
+		{
+			const sm::vec3& p0 = points[loop[i]]->pos;
+			const sm::vec3& p1 = points[loop[(i + 1) % n]]->pos;
+			if ((p1 - p0).LengthSquared() < 0.25f) {
+				continue;
+			}
+			const sm::vec3 edge = (p1 - p0).Normalized();
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				for (int dir = -1; dir <= 1; dir += 2)
+				{
+					sm::vec3 v(0, 0, 0);
+					v[axis] = static_cast<float>(dir);
+					// axial edges give the axial planes again
+					const sm::vec3 cross = edge.Cross(v);
+					if (cross.LengthSquared() < 0.25f) {
+						continue;
+					}
+					const sm::vec3 normal = cross.Normalized();
+					if (HasPlane(planes, normal)) {
+						continue;
+					}
+
+					const float dist = normal.Dot(p0);
+					bool behind = true;
+					for (auto& p : points) {
+						if (normal.Dot(p->pos) - dist > BEVEL_DIST_EPSILON) {
+							behind = false;
+							break;
+						}
+					}
+					if (behind) {
+						planes.push_back({ normal, dist });
+					}
+				}
+			}
+		}
+	}
+}
+
+}
+
+namespace quake
+{
+
+const MapCollision::Hull MapCollision::POINT_HULL    = { sm::vec3(0, 0, 0), sm::vec3(0, 0, 0) };
+const MapCollision::Hull MapCollision::PLAYER_HULL   = { sm::vec3(-16, -24, -16), sm::vec3(16, 32, 16) };
+const MapCollision::Hull MapCollision::SHAMBLER_HULL = { sm::vec3(-32, -24, -32), sm::vec3(32, 64, 32) };
+
+const uint32_t MapCollision::MASK_SOLID;
+const uint32_t MapCollision::MASK_PLAYER_SOLID;
+
+void MapCollision::Build(const std::vector<std::shared_ptr<MapEntity>>& entities,
+	                     const std::vector<Hull>& hulls)
+{
+	QUAKE_PROFILE_SCOPE("MapCollision::Build");
+
+	Clear();
+
+	m_hulls = hulls;
+	m_index.Build(entities);
+
+	auto& brushes = m_index.GetBrushes();
+	const size_t num = brushes.size();
+
+	m_contents.assign(num, ContentFlags::Solid);
+	for (size_t i = 0; i < num; ++i)
+	{
+		auto& e = *entities[brushes[i].entity];
+		auto surfaces = e.GetSurfaces(brushes[i].brush);
+		if (!surfaces) {
+			continue;
+		}
+		uint32_t contents = 0;
+		for (size_t j = 0, n = e.brushes[brushes[i].brush]->Faces().size(); j < n; ++j) {
+			contents |= surfaces[j].contents;
+		}
+		m_contents[i] = contents;
+	}
+
+	std::vector<std::vector<BevelPlane>> brush_planes(num);
+	ParallelFor(num, 256, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			BuildBrushPlanes(*entities[brushes[i].entity]->brushes[brushes[i].brush], brush_planes[i]);
+		}
+	});
+
+	// padding planes have every point behind them
+	m_plane_ranges.resize(num);
+	uint32_t plane_num = 0;
+	for (size_t i = 0; i < num; ++i)
+	{
+		const uint32_t count = static_cast<uint32_t>(brush_planes[i].size());
+		m_plane_ranges[i] = { plane_num, count };
+		plane_num += (count + 3) & ~3u;
+	}
+	m_nx.assign(plane_num, 0.0f);
+	m_ny.assign(plane_num, 0.0f);
+	m_nz.assign(plane_num, 0.0f);
+	m_dists.assign(hulls.size(), std::vector<float>(plane_num, 1.0f));
+
+	ParallelFor(num, 256, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			uint32_t dst = m_plane_ranges[i].first;
+			for (auto& p : brush_planes[i])
+			{
+				m_nx[dst] = p.normal.x;
+				m_ny[dst] = p.normal.y;
+				m_nz[dst] = p.normal.z;
+
+				// pushed out by the box corner that is furthest behind the plane
+				for (size_t h = 0, n = hulls.size(); h < n; ++h)
+				{
+					float ofs = 0;
+					for (int k = 0; k < 3; ++k) {
+						ofs += p.normal[k] * (p.normal[k] < 0 ? hulls[h].max[k] : hulls[h].min[k]);
+					}
+					m_dists[h][dst] = p.dist - ofs;
+				}
+				++dst;
+			}
+		}
+	});
+}
+
+void MapCollision::Clear()
+{
+	m_hulls.clear();
+	m_index.Clear();
+	m_contents.clear();
+	m_nx.clear();
+	m_ny.clear();
+	m_nz.clear();
+	m_dists.clear();
+	m_plane_ranges.clear();
+}
+
+void MapCollision::TraceBox(size_t hull, const sm::vec3& start, const sm::vec3& end,
+	                        Trace& trace, uint32_t mask) const
+{
+	trace = Trace();
+
+	const sm::vec3 delta = end - start;
+	m_index.QuerySweep(start, delta, m_hulls[hull].min, m_hulls[hull].max, [&](uint32_t brush)
+	{
+		if ((m_contents[brush] & mask) != 0) {
+			ClipToBrush(hull, brush, start, end, trace);
+		}
+		return trace.fraction;
+	});
+
+	trace.end = trace.fraction == 1.0f ? end : start + delta * trace.fraction;
+}
+
+void MapCollision::TraceBoxBatch(size_t hull, const sm::vec3* start, const sm::vec3* end, size_t count,
+	                             Trace* traces, uint32_t mask) const
+{
+	ParallelFor(count, 256, [&](size_t begin, size_t end_idx) {
+		for (size_t i = begin; i < end_idx; ++i) {
+			TraceBox(hull, start[i], end[i], traces[i], mask);
+		}
+	});
+}
+
+uint32_t MapCollision::PointContents(size_t hull, const sm::vec3& pos) const
+{
+	uint32_t contents = 0;
+	m_index.QuerySweep(pos, sm::vec3(0, 0, 0), m_hulls[hull].min, m_hulls[hull].max, [&](uint32_t brush)
+	{
+		if ((contents & m_contents[brush]) != m_contents[brush] && IsInside(hull, brush, pos)) {
+			contents |= m_contents[brush];
+		}
+		return 1.0f;
+	});
+	return contents;
+}
+
+// quake 2's CM_ClipBoxToBrush against the planes already expanded by the hull
+void MapCollision::ClipToBrush(size_t hull, uint32_t brush, const sm::vec3& start,
+	                           const sm::vec3& end, Trace& trace) const
+{
+	auto& range = m_plane_ranges[brush];
+	auto& dists = m_dists[hull];
+	const uint32_t last = range.first + ((range.count + 3) & ~3u);
+
+	float enter_frac = -1;
+	float leave_frac = 1;
+	bool start_out = false;
+	bool end_out = false;
+
+#ifdef QUAKE_SIMD_SSE2
+	const __m128 sx = _mm_set1_ps(start.x), sy = _mm_set1_ps(start.y), sz = _mm_set1_ps(start.z);
+	const __m128 ex = _mm_set1_ps(end.x), ey = _mm_set1_ps(end.y), ez = _mm_set1_ps(end.z);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 eps  = _mm_set1_ps(DIST_EPSILON);
+	__m128 enter4 = _mm_set1_ps(-1.0f);
+	__m128 leave4 = _mm_set1_ps(1.0f);
+	int start_out_mask = 0, end_out_mask = 0;
+	for (uint32_t i = range.first; i < last; i += 4)
+	{
+		const __m128 nx = _mm_loadu_ps(&m_nx[i]);
+		const __m128 ny = _mm_loadu_ps(&m_ny[i]);
+		const __m128 nz = _mm_loadu_ps(&m_nz[i]);
+		const __m128 d  = _mm_loadu_ps(&dists[i]);
+
+		const __m128 d1 = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, sx), _mm_mul_ps(ny, sy)), _mm_mul_ps(nz, sz)), d);
+		const __m128 d2 = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, ex), _mm_mul_ps(ny, ey)), _mm_mul_ps(nz, ez)), d);
+
+		const __m128 out1 = _mm_cmpgt_ps(d1, zero);
+		const __m128 out2 = _mm_cmpgt_ps(d2, zero);
+
+		// in front of a plane all the way
+		if (_mm_movemask_ps(_mm_and_ps(out1, _mm_cmpge_ps(d2, d1))) != 0) {
+			return;
+		}
+		start_out_mask |= _mm_movemask_ps(out1);
+		end_out_mask   |= _mm_movemask_ps(out2);
+
+		const __m128 crossing = _mm_or_ps(out1, out2);
+		const __m128 entering = _mm_and_ps(crossing, _mm_cmpgt_ps(d1, d2));
+		const __m128 leaving  = _mm_andnot_ps(entering, crossing);
+
+		const __m128 denom = _mm_sub_ps(d1, d2);
+		const __m128 safe  = _mm_or_ps(denom, _mm_and_ps(_mm_cmpeq_ps(denom, zero), _mm_set1_ps(1.0f)));
+		const __m128 f_enter = _mm_div_ps(_mm_sub_ps(d1, eps), safe);
+		const __m128 f_leave = _mm_div_ps(_mm_add_ps(d1, eps), safe);
+		enter4 = _mm_max_ps(enter4, _mm_or_ps(_mm_and_ps(entering, f_enter), _mm_andnot_ps(entering, _mm_set1_ps(-1.0f))));
+		leave4 = _mm_min_ps(leave4, _mm_or_ps(_mm_and_ps(leaving, f_leave), _mm_andnot_ps(leaving, _mm_set1_ps(1.0f))));
+	}
+	enter4 = _mm_max_ps(enter4, _mm_shuffle_ps(enter4, enter4, _MM_SHUFFLE(1, 0, 3, 2)));
+	enter4 = _mm_max_ps(enter4, _mm_shuffle_ps(enter4, enter4, _MM_SHUFFLE(2, 3, 0, 1)));
+	leave4 = _mm_min_ps(leave4, _mm_shuffle_ps(leave4, leave4, _MM_SHUFFLE(1, 0, 3, 2)));
+	leave4 = _mm_min_ps(leave4, _mm_shuffle_ps(leave4, leave4, _MM_SHUFFLE(2, 3, 0, 1)));
+	enter_frac = _mm_cvtss_f32(enter4);
+	leave_frac = _mm_cvtss_f32(leave4);
+	start_out  = start_out_mask != 0;
+	end_out    = end_out_mask != 0;
+#else
+	for (uint32_t i = range.first; i < last; ++i)
+	{
+		const float d1 = m_nx[i] * start.x + m_ny[i] * start.y + m_nz[i] * start.z - dists[i];
+		const float d2 = m_nx[i] * end.x + m_ny[i] * end.y + m_nz[i] * end.z - dists[i];
+		if (d1 > 0) {
+			start_out = true;
+		}
+		if (d2 > 0) {
+			end_out = true;
+		}
+		if (d1 > 0 && d2 >= d1) {
+			return;
+		}
+		if (d1 <= 0 && d2 <= 0) {
+			continue;
+		}
+		if (d1 > d2) {
+			enter_frac = std::max(enter_frac, (d1 - DIST_EPSILON) / (d1 - d2));
+		} else {
+			leave_frac = std::min(leave_frac, (d1 + DIST_EPSILON) / (d1 - d2));
+		}
+	}
+#endif // QUAKE_SIMD_SSE2
+
+	if (!start_out)
+	{
+		trace.start_solid = true;
+		if (!end_out) {
+			trace.all_solid = true;
+			trace.fraction  = 0;
+			trace.brush     = static_cast<int>(brush);
+			trace.contents  = m_contents[brush];
+		}
+		return;
+	}
+
+	if (enter_frac >= leave_frac || enter_frac <= -1 || enter_frac >= trace.fraction) {
+		return;
+	}
+
+	trace.fraction = std::max(enter_frac, 0.0f);
+	trace.brush    = static_cast<int>(brush);
+	trace.contents = m_contents[brush];
+
+	// the plane entered last
+	float best = -FLT_MAX;
+	for (uint32_t i = range.first; i < range.first + range.count; ++i)
+	{
+		const float d1 = m_nx[i] * start.x + m_ny[i] * start.y + m_nz[i] * start.z - dists[i];
+		const float d2 = m_nx[i] * end.x + m_ny[i] * end.y + m_nz[i] * end.z - dists[i];
+		if (d1 > d2 && d1 > 0)
+		{
+			const float f = (d1 - DIST_EPSILON) / (d1 - d2);
+			if (f > best) {
+				best = f;
+				trace.normal = sm::vec3(m_nx[i], m_ny[i], m_nz[i]);
+			}
+		}
+	}
+}
+
+bool MapCollision::IsInside(size_t hull, uint32_t brush, const sm::vec3& pos) const
+{
+	auto& range = m_plane_ranges[brush];
+	auto& dists = m_dists[hull];
+	const uint32_t last = range.first + ((range.count + 3) & ~3u);
+
+#ifdef QUAKE_SIMD_SSE2
+	const __m128 px = _mm_set1_ps(pos.x), py = _mm_set1_ps(pos.y), pz = _mm_set1_ps(pos.z);
+	for (uint32_t i = range.first; i < last; i += 4)
+	{
+		const __m128 dot = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_loadu_ps(&m_nx[i]), px),
+			_mm_mul_ps(_mm_loadu_ps(&m_ny[i]), py)),
+			_mm_mul_ps(_mm_loadu_ps(&m_nz[i]), pz));
+		if (_mm_movemask_ps(_mm_cmpgt_ps(dot, _mm_loadu_ps(&dists[i]))) != 0) {
+			return false;
+		}
+	}
+#else
+	for (uint32_t i = range.first; i < last; ++i) {
+		if (m_nx[i] * pos.x + m_ny[i] * pos.y + m_nz[i] * pos.z > dists[i]) {
+			return false;
+		}
+	}
+#endif // QUAKE_SIMD_SSE2
+
+	return true;
+}
+
+}
@@ -0,0 +1,35 @@
+#include "quake/MapContext.h"
+#include "quake/TextureManager.h"
+#include "quake/Lightmaps.h"
+#include "quake/Profiler.h"
+
+namespace quake
+{
+
+MapContext::MapContext()
+	: m_textures(std::make_unique<TextureManager>())
+	, m_lightmaps(std::make_unique<Lightmaps>())
+	, m_own_profiler(std::make_unique<Profiler>())
+	, m_profiler(m_own_profiler.get())
+{
+}
+
+MapContext::MapContext(Profiler* profiler)
+	: m_textures(std::make_unique<TextureManager>())
+	, m_lightmaps(std::make_unique<Lightmaps>())
+	, m_profiler(profiler)
+{
+}
+
+MapContext::~MapContext()
+{
+}
+
+MapContext& MapContext::Default()
+{
+	// never destroyed, like the singletons it replaces
+	static MapContext* ctx = new MapContext(Profiler::Instance());
+	return *ctx;
+}
+
+}
@@ -0,0 +1,534 @@
+#include "quake/MapCorpusScanner.h"
+#include "quake/MapParser.h"
+#include "quake/MapAttributes.h"
+#include "quake/WadFileLoader.h"
+#include "quake/ParallelFor.h"
+#include "quake/Profiler.h"
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <unordered_set>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <exception>
+
+#include <stdio.h>
+
+namespace
+{
+
+bool EndsWithNoCase(const std::string& str, const std::string& suffix)
+{
+	if (str.size() < suffix.size()) {
+		return false;
+	}
+	return std::equal(suffix.begin(), suffix.end(), str.end() - suffix.size(),
+		[](char a, char b) { return tolower(a) == tolower(b); });
+}
+
+std::string ToLower(std::string str)
+{
+	std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+	return str;
+}
+
+bool ReadFile(const std::string& filepath, std::vector<char>& buf)
+{
+	std::ifstream fin(filepath, std::ios::binary | std::ios::ate);
+	if (fin.fail()) {
+		return false;
+	}
+	buf.resize(static_cast<size_t>(fin.tellg()));
+	fin.seekg(0, std::ios::beg);
+	fin.read(buf.data(), buf.size());
+	return !fin.fail();
+}
+
+template <typename Iterator>
+void ListFiles(Iterator itr, const std::string& ext, std::vector<std::string>& files)
+{
+	boost::system::error_code ec;
+	for (Iterator end; itr != end; itr.increment(ec))
+	{
+		if (ec) {
+			break;
+		}
+		if (boost::filesystem::is_regular_file(itr->path(), ec) &&
+			EndsWithNoCase(itr->path().string(), ext)) {
+			files.push_back(itr->path().string());
+		}
+	}
+}
+
+void WriteJsonString(std::ostream& os, const std::string& str)
+{
+	os << '"';
+	for (char c : str)
+	{
+		switch (c)
+		{
+		case '"':
+			os << "\\\"";
+			break;
+		case '\\':
+			os << "\\\\";
+			break;
+		case '\n':
+			os << "\\n";
+			break;
+		case '\r':
+			os << "\\r";
+			break;
+		case '\t':
+			os << "\\t";
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\u%04x", c);
+				os << buf;
+			} else {
+				os << c;
+			}
+		}
+	}
+	os << '"';
+}
+
+void WriteCsvField(std::ostream& os, const std::string& str)
+{
+	if (str.find_first_of(",\"\n\r") == std::string::npos) {
+		os << str;
+		return;
+	}
+
+	os << '"';
+	for (char c : str) {
+		if (c == '"') {
+			os << '"';
+		}
+		os << c;
+	}
+	os << '"';
+}
+
+// the textures taken from a wad, none for textures and classnames
+void WriteJsonTextures(std::ostream&, const quake::MapCorpusScanner::Usage&)
+{
+}
+
+void WriteJsonTextures(std::ostream& os, const quake::MapCorpusScanner::WadUsage& usage)
+{
+	os << ",\n      \"textures\": {";
+	bool first = true;
+	for (auto& itr : usage.textures)
+	{
+		os << (first ? " " : ", ");
+		WriteJsonString(os, itr.first);
+		os << ": { \"faces\": " << itr.second.count << ", \"maps\": " << itr.second.maps << " }";
+		first = false;
+	}
+	os << " }";
+}
+
+// name, count, maps objects sorted by name
+template <typename Usage>
+void WriteJsonUsage(std::ostream& os, const char* key, const char* count_key,
+	                const std::map<std::string, Usage>& usage)
+{
+	os << "  \"" << key << "\": [";
+	bool first = true;
+	for (auto& itr : usage)
+	{
+		os << (first ? "\n    { \"name\": " : ",\n    { \"name\": ");
+		WriteJsonString(os, itr.first);
+		os << ", \"" << count_key << "\": " << itr.second.count;
+		os << ", \"maps\": " << itr.second.maps;
+		WriteJsonTextures(os, itr.second);
+		os << " }";
+		first = false;
+	}
+	os << "\n  ],\n";
+}
+
+// sorted so the output doesn't depend on hashing
+template <typename Map>
+std::vector<std::pair<std::string, size_t>> Sorted(const Map& map)
+{
+	std::vector<std::pair<std::string, size_t>> ret(map.begin(), map.end());
+	std::sort(ret.begin(), ret.end());
+	return ret;
+}
+
+}
+
+namespace quake
+{
+
+class MapCorpusScanner::WadNames
+{
+public:
+	typedef std::unordered_set<std::string> Names;
+
+	explicit WadNames(const std::vector<std::string>& wad_dirs)
+		: m_wad_dirs(wad_dirs)
+	{
+	}
+
+	// lower case texture names of the first wad called name in map_dir or
+	// the wad dirs, file names compared case insensitive, null if none
+	std::shared_ptr<const Names> Find(const std::string& map_dir, const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+
+		auto names = FindInDir(map_dir, name);
+		for (size_t i = 0; !names && i < m_wad_dirs.size(); ++i) {
+			names = FindInDir(m_wad_dirs[i], name);
+		}
+		return names;
+	}
+
+private:
+	std::shared_ptr<const Names> FindInDir(const std::string& dir, const std::string& name)
+	{
+		// each dir is listed once, by lower case file name
+		auto dir_itr = m_dirs.find(dir);
+		if (dir_itr == m_dirs.end())
+		{
+			std::vector<std::string> files;
+			boost::system::error_code ec;
+			ListFiles(boost::filesystem::directory_iterator(dir, ec), ".wad", files);
+
+			auto& listing = m_dirs[dir];
+			for (auto& file : files) {
+				listing.insert({ ToLower(boost::filesystem::path(file).filename().string()), file });
+			}
+			dir_itr = m_dirs.find(dir);
+		}
+
+		auto file_itr = dir_itr->second.find(name);
+		if (file_itr == dir_itr->second.end()) {
+			return nullptr;
+		}
+
+		auto& names = m_names[file_itr->second];
+		if (!names)
+		{
+			auto loaded = std::make_shared<Names>();
+			std::vector<char> buf;
+			std::vector<std::string> list;
+			if (ReadFile(file_itr->second, buf) &&
+				WadFileLoader::LoadNames(reinterpret_cast<const unsigned char*>(buf.data()), buf.size(), list)) {
+				for (auto& tex : list) {
+					loaded->insert(ToLower(tex));
+				}
+			}
+			names = loaded;
+		}
+		return names;
+	}
+
+private:
+	std::vector<std::string> m_wad_dirs;
+
+	std::mutex m_mtx;
+	std::unordered_map<std::string, std::unordered_map<std::string, std::string>> m_dirs;
+	std::unordered_map<std::string, std::shared_ptr<const Names>> m_names;
+
+}; // MapCorpusScanner::WadNames
+
+MapCorpusScanner::Result MapCorpusScanner::Scan(const Params& params)
+{
+	QUAKE_PROFILE_SCOPE("MapCorpusScanner::Scan");
+
+	const auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::string> files;
+	boost::system::error_code ec;
+	if (params.recursive) {
+		ListFiles(boost::filesystem::recursive_directory_iterator(params.dir, ec), params.ext, files);
+	} else {
+		ListFiles(boost::filesystem::directory_iterator(params.dir, ec), params.ext, files);
+	}
+	std::sort(files.begin(), files.end());
+
+	Result result;
+	result.maps.resize(files.size());
+
+	// map sizes vary a lot, workers take the next file instead of a fixed slice
+	size_t threads = params.threads > 0 ? params.threads : std::max<size_t>(1, std::thread::hardware_concurrency());
+	threads = std::min(threads, std::max<size_t>(1, files.size()));
+	std::atomic<size_t> next(0), bytes(0);
+	WadNames wad_names(params.wad_dirs);
+	ParallelFor(threads, 1, [&](size_t, size_t)
+	{
+		size_t i;
+		while ((i = next++) < files.size())
+		{
+			size_t size = 0;
+			result.maps[i] = ScanMap(files[i], &size, wad_names);
+			bytes += size;
+		}
+	});
+
+	for (auto& map : result.maps)
+	{
+		if (!map.error.empty()) {
+			++result.failed;
+			continue;
+		}
+
+		for (auto& itr : map.textures)
+		{
+			auto& usage = result.textures[itr.first];
+			usage.count += itr.second;
+			++usage.maps;
+
+			auto wad = map.texture_wads.find(itr.first);
+			auto& wad_usage = wad != map.texture_wads.end() ?
+				result.wads[wad->second].textures[itr.first] : result.unresolved[itr.first];
+			wad_usage.count += itr.second;
+			++wad_usage.maps;
+		}
+		for (auto& itr : map.classnames) {
+			auto& usage = result.classnames[itr.first];
+			usage.count += itr.second;
+			++usage.maps;
+		}
+		for (auto& wad : map.wads) {
+			auto& usage = result.wads[wad.name];
+			usage.count += wad.faces;
+			++usage.maps;
+		}
+	}
+
+	result.bytes = bytes;
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return result;
+}
+
+MapCorpusScanner::MapResult MapCorpusScanner::ScanFile(const std::string& filepath, size_t* bytes,
+	                                                   const std::vector<std::string>& wad_dirs)
+{
+	WadNames wad_names(wad_dirs);
+	return ScanMap(filepath, bytes, wad_names);
+}
+
+MapCorpusScanner::MapResult MapCorpusScanner::ScanMap(const std::string& filepath, size_t* bytes, WadNames& wad_names)
+{
+	MapResult ret;
+	ret.path = filepath;
+
+	std::vector<char> buf;
+	if (!ReadFile(filepath, buf)) {
+		ret.error = "can't open";
+		return ret;
+	}
+	if (bytes) {
+		*bytes = buf.size();
+	}
+
+	try
+	{
+		MapParser parser(buf.data(), buf.data() + buf.size());
+		parser.EnableBrushGeometry(false);
+		parser.Parse();
+
+		auto& entities = parser.GetAllEntities();
+		ret.entities = entities.size();
+		for (auto& e : entities) {
+			++ret.classnames[FindAttribute(e->attributes, AttributeNames::Classname, AttributeValues::NoClassname)];
+		}
+
+		for (auto& itr : parser.GetTextureUsage())
+		{
+			ret.faces += itr.second;
+			// faces without texture are written as __TB_empty and read back as ""
+			if (!itr.first.empty()) {
+				ret.textures.insert(itr);
+			}
+		}
+
+		if (auto world = parser.GetWorldEntity())
+		{
+			auto& wad_key = FindAttribute(world->attributes, AttributeNames::Wad);
+			size_t begin = 0;
+			while (begin < wad_key.size())
+			{
+				auto end = wad_key.find(';', begin);
+				if (end == std::string::npos) {
+					end = wad_key.size();
+				}
+				// the path is the mapper's machine, the name is what matters
+				auto name = ToLower(boost::filesystem::path(wad_key.substr(begin, end - begin)).filename().string());
+				if (!name.empty() && std::find_if(ret.wads.begin(), ret.wads.end(),
+					[&name](const WadResult& wad) { return wad.name == name; }) == ret.wads.end())
+				{
+					WadResult wad;
+					wad.name = name;
+					ret.wads.push_back(wad);
+				}
+				begin = end + 1;
+			}
+		}
+
+		const auto map_dir = boost::filesystem::path(filepath).parent_path().string();
+		std::vector<std::shared_ptr<const WadNames::Names>> wad_textures;
+		wad_textures.reserve(ret.wads.size());
+		for (auto& wad : ret.wads) {
+			wad_textures.push_back(wad_names.Find(map_dir, wad.name));
+			wad.found = wad_textures.back() != nullptr;
+		}
+		for (auto& itr : ret.textures)
+		{
+			const auto name = ToLower(itr.first);
+			for (size_t i = 0, n = ret.wads.size(); i < n; ++i)
+			{
+				if (wad_textures[i] && wad_textures[i]->count(name))
+				{
+					ret.texture_wads.insert({ itr.first, ret.wads[i].name });
+					++ret.wads[i].textures;
+					ret.wads[i].faces += itr.second;
+					break;
+				}
+			}
+		}
+	}
+	catch (const std::exception& e)
+	{
+		ret.error = e.what();
+		if (ret.error.empty()) {
+			ret.error = "parse error";
+		}
+	}
+
+	return ret;
+}
+
+bool MapCorpusScanner::WriteJson(const Result& result, const std::string& filepath)
+{
+	std::ofstream fout(filepath, std::ios::binary);
+	if (fout.fail()) {
+		return false;
+	}
+
+	fout << "{\n";
+	fout << "  \"maps\": " << result.maps.size() << ",\n";
+	fout << "  \"failed\": " << result.failed << ",\n";
+	fout << "  \"bytes\": " << result.bytes << ",\n";
+	fout << "  \"seconds\": " << result.seconds << ",\n";
+
+	WriteJsonUsage(fout, "textures", "faces", result.textures);
+	WriteJsonUsage(fout, "classnames", "entities", result.classnames);
+	WriteJsonUsage(fout, "wads", "faces", result.wads);
+	WriteJsonUsage(fout, "unresolved", "faces", result.unresolved);
+
+	fout << "  \"files\": [";
+	for (size_t i = 0, n = result.maps.size(); i < n; ++i)
+	{
+		auto& map = result.maps[i];
+		fout << (i == 0 ? "\n    { \"path\": " : ",\n    { \"path\": ");
+		WriteJsonString(fout, map.path);
+		if (!map.error.empty()) {
+			fout << ", \"error\": ";
+			WriteJsonString(fout, map.error);
+			fout << " }";
+			continue;
+		}
+
+		fout << ", \"entities\": " << map.entities << ", \"faces\": " << map.faces << ",\n      \"wads\": [";
+		for (size_t j = 0; j < map.wads.size(); ++j)
+		{
+			auto& wad = map.wads[j];
+			fout << (j == 0 ? " { \"name\": " : ", { \"name\": ");
+			WriteJsonString(fout, wad.name);
+			fout << ", \"found\": " << (wad.found ? "true" : "false")
+				 << ", \"textures\": " << wad.textures << ", \"faces\": " << wad.faces << " }";
+		}
+
+		// each texture with its faces and the wad it resolved to
+		fout << " ],\n      \"textures\": {";
+		bool first = true;
+		for (auto& itr : Sorted(map.textures))
+		{
+			fout << (first ? " " : ", ");
+			WriteJsonString(fout, itr.first);
+			fout << ": { \"faces\": " << itr.second << ", \"wad\": ";
+			auto wad = map.texture_wads.find(itr.first);
+			if (wad != map.texture_wads.end()) {
+				WriteJsonString(fout, wad->second);
+			} else {
+				fout << "null";
+			}
+			fout << " }";
+			first = false;
+		}
+
+		fout << " },\n      \"classnames\": {";
+		first = true;
+		for (auto& itr : Sorted(map.classnames)) {
+			fout << (first ? " " : ", ");
+			WriteJsonString(fout, itr.first);
+			fout << ": " << itr.second;
+			first = false;
+		}
+		fout << " } }";
+	}
+	fout << "\n  ]\n}\n";
+
+	fout.close();
+	return !fout.fail();
+}
+
+bool MapCorpusScanner::WriteCsv(const Result& result, const std::string& filepath)
+{
+	std::ofstream fout(filepath, std::ios::binary);
+	if (fout.fail()) {
+		return false;
+	}
+
+	auto write_row = [&fout](const std::string& map, const char* kind, const std::string& name, size_t count,
+		                     const std::string& wad)
+	{
+		WriteCsvField(fout, map);
+		fout << ',' << kind << ',';
+		WriteCsvField(fout, name);
+		fout << ',' << count << ',';
+		WriteCsvField(fout, wad);
+		fout << '\n';
+	};
+
+	fout << "map,kind,name,count,wad\n";
+	for (auto& map : result.maps)
+	{
+		if (!map.error.empty()) {
+			continue;
+		}
+		for (auto& itr : Sorted(map.textures))
+		{
+			auto wad = map.texture_wads.find(itr.first);
+			if (wad != map.texture_wads.end()) {
+				write_row(map.path, "texture", itr.first, itr.second, wad->second);
+			} else {
+				write_row(map.path, "unresolved", itr.first, itr.second, "");
+			}
+		}
+		for (auto& itr : Sorted(map.classnames)) {
+			write_row(map.path, "classname", itr.first, itr.second, "");
+		}
+		for (auto& wad : map.wads) {
+			write_row(map.path, "wad", wad.name, wad.faces, "");
+		}
+	}
+
+	fout.close();
+	return !fout.fail();
+}
+
+}
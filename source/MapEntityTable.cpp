@@ -0,0 +1,202 @@
+#include "quake/MapEntityTable.h"
+#include "quake/SIMD.h"
+#include "quake/MemoryReport.h"
+
+#include <limits>
+
+#include <stdlib.h>
+
+namespace
+{
+
+bool ParseFloats(const std::string& str, float* out, int count)
+{
+	const char* p = str.c_str();
+	for (int i = 0; i < count; ++i)
+	{
+		char* end = nullptr;
+		out[i] = strtof(p, &end);
+		if (end == p) {
+			return false;
+		}
+		p = end;
+	}
+	return true;
+}
+
+}
+
+namespace quake
+{
+
+void MapEntityTable::AddEntity(const std::vector<EntityAttribute>& attributes)
+{
+	uint32_t classname = NO_NAME, targetname = NO_NAME;
+	uint32_t spawnflags = 0;
+
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	float origin[3] = { nan, nan, nan };
+
+	// "angles" over "mangle" over "angle"
+	float angles[3] = { 0, 0, 0 };
+	int angles_priority = 0;
+
+	for (auto& attr : attributes)
+	{
+		if (attr.name == AttributeNames::Classname) {
+			classname = InternName(attr.val);
+		} else if (attr.name == AttributeNames::Targetname) {
+			targetname = InternName(attr.val);
+		} else if (attr.name == AttributeNames::Spawnflags) {
+			spawnflags = static_cast<uint32_t>(strtol(attr.val.c_str(), nullptr, 10));
+		} else if (attr.name == AttributeNames::Origin) {
+			float v[3];
+			if (ParseFloats(attr.val, v, 3)) {
+				origin[0] = v[0];
+				origin[1] = v[2];
+				origin[2] = v[1];
+			}
+		} else if (attr.name == AttributeNames::Angles && angles_priority < 3) {
+			if (ParseFloats(attr.val, angles, 3)) {
+				angles_priority = 3;
+			}
+		} else if (attr.name == AttributeNames::Mangle && angles_priority < 2) {
+			if (ParseFloats(attr.val, angles, 3)) {
+				angles_priority = 2;
+			}
+		} else if (attr.name == AttributeNames::Angle && angles_priority < 1) {
+			if (ParseFloats(attr.val, &angles[1], 1)) {
+				angles[0] = angles[2] = 0;
+				angles_priority = 1;
+			}
+		}
+	}
+
+	m_classnames.push_back(classname);
+	m_targetnames.push_back(targetname);
+	m_spawnflags.push_back(spawnflags);
+	m_origin_x.push_back(origin[0]);
+	m_origin_y.push_back(origin[1]);
+	m_origin_z.push_back(origin[2]);
+	m_angles.push_back(sm::vec3(angles[0], angles[1], angles[2]));
+}
+
+void MapEntityTable::Clear()
+{
+	m_names.clear();
+	m_name2id.clear();
+
+	m_classnames.clear();
+	m_targetnames.clear();
+	m_spawnflags.clear();
+	m_origin_x.clear();
+	m_origin_y.clear();
+	m_origin_z.clear();
+	m_angles.clear();
+}
+
+size_t MapEntityTable::GetMemoryBytes() const
+{
+	size_t bytes = MemoryBytes::Vector(m_names) + MemoryBytes::Hash(m_name2id);
+	for (auto& name : m_names) {
+		bytes += MemoryBytes::String(name) * 2;
+	}
+
+	bytes += MemoryBytes::Vector(m_classnames);
+	bytes += MemoryBytes::Vector(m_targetnames);
+	bytes += MemoryBytes::Vector(m_spawnflags);
+	bytes += MemoryBytes::Vector(m_origin_x);
+	bytes += MemoryBytes::Vector(m_origin_y);
+	bytes += MemoryBytes::Vector(m_origin_z);
+	bytes += MemoryBytes::Vector(m_angles);
+
+	return bytes;
+}
+
+uint32_t MapEntityTable::FindName(const std::string& name) const
+{
+	auto itr = m_name2id.find(name);
+	return itr == m_name2id.end() ? NO_NAME : itr->second;
+}
+
+sm::vec3 MapEntityTable::GetOrigin(size_t entity) const
+{
+	return sm::vec3(m_origin_x[entity], m_origin_y[entity], m_origin_z[entity]);
+}
+
+bool MapEntityTable::HasOrigin(size_t entity) const
+{
+	// NaN isn't equal to itself
+	return m_origin_x[entity] == m_origin_x[entity];
+}
+
+void MapEntityTable::QueryBox(const sm::vec3& min, const sm::vec3& max, uint32_t spawnflags_mask,
+	                          std::vector<uint32_t>& entities) const
+{
+	const size_t n = Size();
+	size_t i = 0;
+#ifdef QUAKE_SIMD_SSE2
+	// entities without origin fail every compare against NaN
+	const __m128 min_x = _mm_set1_ps(min.x), max_x = _mm_set1_ps(max.x);
+	const __m128 min_y = _mm_set1_ps(min.y), max_y = _mm_set1_ps(max.y);
+	const __m128 min_z = _mm_set1_ps(min.z), max_z = _mm_set1_ps(max.z);
+	const __m128i mask = _mm_set1_epi32(static_cast<int>(spawnflags_mask));
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i all  = _mm_cmpeq_epi32(zero, zero);
+	for ( ; i + 4 <= n; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(&m_origin_x[i]);
+		const __m128 y = _mm_loadu_ps(&m_origin_y[i]);
+		const __m128 z = _mm_loadu_ps(&m_origin_z[i]);
+		__m128 in = _mm_and_ps(_mm_cmpge_ps(x, min_x), _mm_cmple_ps(x, max_x));
+		in = _mm_and_ps(in, _mm_and_ps(_mm_cmpge_ps(y, min_y), _mm_cmple_ps(y, max_y)));
+		in = _mm_and_ps(in, _mm_and_ps(_mm_cmpge_ps(z, min_z), _mm_cmple_ps(z, max_z)));
+		if (spawnflags_mask != 0)
+		{
+			const __m128i flags = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_spawnflags[i]));
+			const __m128i any = _mm_xor_si128(_mm_cmpeq_epi32(_mm_and_si128(flags, mask), zero), all);
+			in = _mm_and_ps(in, _mm_castsi128_ps(any));
+		}
+
+		const int bits = _mm_movemask_ps(in);
+		for (int j = 0; j < 4; ++j) {
+			if (bits & (1 << j)) {
+				entities.push_back(static_cast<uint32_t>(i + j));
+			}
+		}
+	}
+#endif // QUAKE_SIMD_SSE2
+	for ( ; i < n; ++i)
+	{
+		const bool in = m_origin_x[i] >= min.x && m_origin_x[i] <= max.x &&
+			            m_origin_y[i] >= min.y && m_origin_y[i] <= max.y &&
+			            m_origin_z[i] >= min.z && m_origin_z[i] <= max.z;
+		if (in && (spawnflags_mask == 0 || (m_spawnflags[i] & spawnflags_mask) != 0)) {
+			entities.push_back(static_cast<uint32_t>(i));
+		}
+	}
+}
+
+void MapEntityTable::QueryClassname(uint32_t classname, std::vector<uint32_t>& entities) const
+{
+	for (size_t i = 0, n = m_classnames.size(); i < n; ++i) {
+		if (m_classnames[i] == classname) {
+			entities.push_back(static_cast<uint32_t>(i));
+		}
+	}
+}
+
+uint32_t MapEntityTable::InternName(const std::string& name)
+{
+	auto itr = m_name2id.find(name);
+	if (itr != m_name2id.end()) {
+		return itr->second;
+	}
+
+	const uint32_t id = static_cast<uint32_t>(m_names.size());
+	m_names.push_back(name);
+	m_name2id.insert({ name, id });
+	return id;
+}
+
+}
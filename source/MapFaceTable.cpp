@@ -0,0 +1,242 @@
+#include "quake/MapFaceTable.h"
+#include "quake/MemoryReport.h"
+
+#include <algorithm>
+
+#include <math.h>
+#include <string.h>
+
+namespace
+{
+
+int PlaneHashKey(float dist)
+{
+	return static_cast<int>(floorf(fabsf(dist)));
+}
+
+sm::Plane MakePlane(const sm::vec3& normal, float dist)
+{
+	sm::Plane plane;
+	plane.normal = normal;
+	plane.dist   = dist;
+	return plane;
+}
+
+uint64_t HashFloats(const float* data, size_t n, uint64_t h)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		uint32_t bits;
+		memcpy(&bits, &data[i], sizeof(bits));
+		h ^= bits;
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+}
+
+namespace quake
+{
+
+const float MapFaceTable::NORMAL_EPSILON = 0.00001f;
+const float MapFaceTable::DIST_EPSILON   = 0.01f;
+
+uint32_t MapFaceTable::AddPlane(const sm::Plane& plane)
+{
+	BuildIndex();
+
+	sm::vec3 normal = plane.normal;
+	float dist = plane.dist;
+	SnapPlane(normal, dist);
+
+	int idx = FindPlane(normal, dist);
+	if (idx >= 0) {
+		return static_cast<uint32_t>(idx);
+	}
+
+	const uint32_t front = static_cast<uint32_t>(m_planes.size());
+	m_planes.push_back(MakePlane(normal, dist));
+	m_planes.push_back(MakePlane(-normal, -dist));
+	// both sides share the same key, as it only depends on |dist|
+	m_plane_hash.insert({ PlaneHashKey(dist), front });
+
+	return front;
+}
+
+uint32_t MapFaceTable::AddTexture(const std::string& name)
+{
+	BuildIndex();
+
+	auto itr = m_tex2idx.find(name);
+	if (itr != m_tex2idx.end()) {
+		return itr->second;
+	}
+
+	const uint32_t idx = static_cast<uint32_t>(m_textures.size());
+	m_textures.push_back(name);
+	m_tex2idx.insert({ name, idx });
+	return idx;
+}
+
+uint32_t MapFaceTable::AddTexInfo(uint32_t tex, const sm::vec2& offset, float angle, const sm::vec2& scale)
+{
+	BuildIndex();
+
+	TexInfo info;
+	info.tex    = tex;
+	info.offset = offset;
+	info.angle  = angle;
+	info.scale  = scale;
+
+	const uint64_t hash = HashTexInfo(info);
+
+	auto range = m_texinfo_hash.equal_range(hash);
+	for (auto itr = range.first; itr != range.second; ++itr)
+	{
+		auto& t = m_texinfos[itr->second];
+		if (t.tex == info.tex &&
+			t.offset.x == info.offset.x && t.offset.y == info.offset.y &&
+			t.angle == info.angle &&
+			t.scale.x == info.scale.x && t.scale.y == info.scale.y) {
+			return itr->second;
+		}
+	}
+
+	const uint32_t idx = static_cast<uint32_t>(m_texinfos.size());
+	m_texinfos.push_back(info);
+	m_texinfo_hash.insert({ hash, idx });
+	return idx;
+}
+
+void MapFaceTable::AddBrush(uint32_t entity, uint32_t brush, const std::vector<Face>& faces)
+{
+	Brush b;
+	b.entity     = entity;
+	b.brush      = brush;
+	b.first_face = static_cast<uint32_t>(m_faces.size());
+	b.num_faces  = static_cast<uint32_t>(faces.size());
+	m_brushes.push_back(b);
+
+	std::copy(faces.begin(), faces.end(), std::back_inserter(m_faces));
+}
+
+void MapFaceTable::Compact()
+{
+	decltype(m_plane_hash)().swap(m_plane_hash);
+	decltype(m_tex2idx)().swap(m_tex2idx);
+	decltype(m_texinfo_hash)().swap(m_texinfo_hash);
+	m_indexed = false;
+
+	m_planes.shrink_to_fit();
+	m_textures.shrink_to_fit();
+	m_texinfos.shrink_to_fit();
+	m_faces.shrink_to_fit();
+	m_brushes.shrink_to_fit();
+}
+
+void MapFaceTable::Clear()
+{
+	m_planes.clear();
+	m_plane_hash.clear();
+
+	m_textures.clear();
+	m_tex2idx.clear();
+
+	m_texinfos.clear();
+	m_texinfo_hash.clear();
+
+	m_faces.clear();
+	m_brushes.clear();
+
+	m_indexed = true;
+}
+
+size_t MapFaceTable::GetMemoryBytes() const
+{
+	size_t bytes = MemoryBytes::Vector(m_planes) + MemoryBytes::Hash(m_plane_hash);
+
+	bytes += MemoryBytes::Vector(m_textures) + MemoryBytes::Hash(m_tex2idx);
+	for (auto& tex : m_textures) {
+		bytes += MemoryBytes::String(tex) * (m_indexed ? 2 : 1);
+	}
+
+	bytes += MemoryBytes::Vector(m_texinfos) + MemoryBytes::Hash(m_texinfo_hash);
+	bytes += MemoryBytes::Vector(m_faces);
+	bytes += MemoryBytes::Vector(m_brushes);
+
+	return bytes;
+}
+
+void MapFaceTable::SnapPlane(sm::vec3& normal, float& dist)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		if (fabsf(normal[i] - 1) < NORMAL_EPSILON) {
+			normal = sm::vec3(0, 0, 0);
+			normal[i] = 1;
+			break;
+		}
+		if (fabsf(normal[i] + 1) < NORMAL_EPSILON) {
+			normal = sm::vec3(0, 0, 0);
+			normal[i] = -1;
+			break;
+		}
+	}
+
+	const float rounded = floorf(dist + 0.5f);
+	if (fabsf(dist - rounded) < DIST_EPSILON) {
+		dist = rounded;
+	}
+}
+
+uint64_t MapFaceTable::HashTexInfo(const TexInfo& info)
+{
+	const float vals[] = { info.offset.x, info.offset.y, info.angle, info.scale.x, info.scale.y };
+	return HashFloats(vals, 5, 0xcbf29ce484222325ull ^ info.tex);
+}
+
+void MapFaceTable::BuildIndex()
+{
+	if (m_indexed) {
+		return;
+	}
+
+	for (uint32_t i = 0, n = static_cast<uint32_t>(m_planes.size()); i < n; i += 2) {
+		m_plane_hash.insert({ PlaneHashKey(m_planes[i].dist), i });
+	}
+	for (uint32_t i = 0, n = static_cast<uint32_t>(m_textures.size()); i < n; ++i) {
+		m_tex2idx.insert({ m_textures[i], i });
+	}
+	for (uint32_t i = 0, n = static_cast<uint32_t>(m_texinfos.size()); i < n; ++i) {
+		m_texinfo_hash.insert({ HashTexInfo(m_texinfos[i]), i });
+	}
+
+	m_indexed = true;
+}
+
+int MapFaceTable::FindPlane(const sm::vec3& normal, float dist) const
+{
+	const int key = PlaneHashKey(dist);
+	for (int k = key - 1; k <= key + 1; ++k)
+	{
+		auto range = m_plane_hash.equal_range(k);
+		for (auto itr = range.first; itr != range.second; ++itr)
+		{
+			for (uint32_t side = 0; side < 2; ++side)
+			{
+				const uint32_t idx = itr->second + side;
+				auto& p = m_planes[idx];
+				if (fabsf(p.normal.x - normal.x) < NORMAL_EPSILON &&
+					fabsf(p.normal.y - normal.y) < NORMAL_EPSILON &&
+					fabsf(p.normal.z - normal.z) < NORMAL_EPSILON &&
+					fabsf(p.dist - dist) < DIST_EPSILON) {
+					return static_cast<int>(idx);
+				}
+			}
+		}
+	}
+	return -1;
+}
+
+}
@@ -0,0 +1,487 @@
+#include "quake/MapLoader.h"
+#include "quake/TaskPool.h"
+#include "quake/MapParser.h"
+#include "quake/PakFileSystem.h"
+#include "quake/TextureManager.h"
+#include "quake/TextureUploader.h"
+#include "quake/Lightmaps.h"
+#include "quake/Profiler.h"
+#include "quake/MemoryReport.h"
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <chrono>
+#include <exception>
+
+namespace
+{
+
+template <typename T>
+bool ReadFile(const std::string& filepath, std::vector<T>& buf)
+{
+	std::ifstream fin(filepath, std::ios::binary | std::ios::ate);
+	if (fin.fail()) {
+		return false;
+	}
+
+	buf.resize(static_cast<size_t>(fin.tellg()));
+	fin.seekg(0, std::ios::beg);
+	fin.read(reinterpret_cast<char*>(buf.data()), buf.size());
+	return !fin.fail();
+}
+
+// value of the "wad" key in the first entity, read without tokenizing
+// so the wads can be decoded while the rest of the map is parsed
+std::string ScanWadKey(const char* begin, const char* end)
+{
+	static const char KEY[] = "\"wad\"";
+	static const size_t KEY_LEN = sizeof(KEY) - 1;
+
+	int depth = 0;
+	for (const char* p = begin; p < end; ++p)
+	{
+		switch (*p)
+		{
+		case '{':
+			// first brush, worldspawn keys are done
+			if (++depth > 1) {
+				return "";
+			}
+			break;
+		case '}':
+			return "";
+		case '/':
+			if (p + 1 < end && p[1] == '/') {
+				while (p < end && *p != '\n') {
+					++p;
+				}
+			}
+			break;
+		case '"':
+		{
+			if (depth == 1 && static_cast<size_t>(end - p) > KEY_LEN &&
+				strncmp(p, KEY, KEY_LEN) == 0)
+			{
+				p += KEY_LEN;
+				while (p < end && *p != '"') {
+					++p;
+				}
+				const char* val = ++p;
+				while (p < end && *p != '"') {
+					++p;
+				}
+				return std::string(val, p < end ? p : end);
+			}
+			// skip the whole string
+			++p;
+			while (p < end && *p != '"') {
+				++p;
+			}
+		}
+			break;
+		}
+	}
+	return "";
+}
+
+}
+
+namespace quake
+{
+
+MapLoader::MapLoader(TaskPool& pool, const Palette& palette, MapContext& ctx)
+	: m_pool(pool)
+	, m_palette(palette)
+	, m_ctx(ctx)
+	, m_status(Status::Idle)
+	, m_cancel(false)
+	, m_wads_total(0)
+	, m_wads_decoded(0)
+	, m_tex_total(0)
+	, m_tex_uploaded(0)
+{
+}
+
+MapLoader::~MapLoader()
+{
+	Cancel();
+	WaitAll();
+}
+
+bool MapLoader::Start(const Params& params)
+{
+	if (m_status == Status::Running || m_status == Status::Uploading) {
+		return false;
+	}
+
+	WaitAll();
+
+	m_params = params;
+
+	m_cancel = false;
+	m_map_data.clear();
+	m_parser.reset();
+	m_wad_futures.clear();
+	m_wads.clear();
+	m_upload_wad = m_upload_tex = 0;
+	m_claimed.clear();
+	m_error.clear();
+	m_wads_total = m_wads_decoded = 0;
+	m_tex_total = m_tex_uploaded = 0;
+
+	m_status = Status::Running;
+	// the tasks, and the ones they submit, record into the context's
+	ProfileBind bind(&m_ctx.GetProfiler());
+	m_parse_future = m_pool.Submit([this]() { ParseTask(); });
+
+	return true;
+}
+
+void MapLoader::Cancel()
+{
+	m_cancel = true;
+}
+
+MapLoader::Status MapLoader::Update(TextureUploader& uploader, double budget_ms)
+{
+	if (m_status == Status::Running && m_cancel) {
+		m_status = Status::Cancelled;
+	}
+	if (m_status != Status::Uploading) {
+		return m_status;
+	}
+	if (m_cancel) {
+		m_status = Status::Cancelled;
+		return m_status;
+	}
+
+	ProfileBind bind(&m_ctx.GetProfiler());
+	QUAKE_PROFILE_SCOPE("MapLoader::Update");
+
+	auto& tex_mgr = m_ctx.GetTextures();
+
+	const auto start = std::chrono::steady_clock::now();
+	const auto budget = std::chrono::duration<double, std::milli>(budget_ms);
+	while (m_upload_wad < m_wads.size())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			if (!m_wads[m_upload_wad].done) {
+				return m_status;
+			}
+		}
+
+		auto& textures = m_wads[m_upload_wad].textures;
+		if (m_upload_tex == textures.size()) {
+			++m_upload_wad;
+			m_upload_tex = 0;
+			continue;
+		}
+
+		auto& tex = textures[m_upload_tex];
+
+		// copies without pixels count what the upload takes
+		const size_t bytes = !tex.Empty() ? tex.Bytes() : m_params.compress_textures
+			? TextureCompressor::CompressedSize(m_params.compression.format, tex.width, tex.height)
+			: tex.width * tex.height * 3;
+
+		// uploaded from an earlier wad or load
+		if (tex_mgr.AddShared(tex.name, tex.hash, bytes)) {
+			tex = WadFileLoader::DecodedTexture();
+		} else {
+			// a copy whose pixels a later wad's task decodes
+			if (tex.Empty() && !TakePixels(tex.hash, m_upload_wad, tex))
+			{
+				std::lock_guard<std::mutex> lock(m_mtx);
+				if (m_wads_decoded < m_wads_total) {
+					return m_status;
+				}
+			}
+			if (!tex.Empty())
+			{
+				ur::TexturePtr t;
+				if (tex.compressed.levels.empty())
+				{
+					t = uploader.CreateTexture(tex.width, tex.height, ur::TextureFormat::RGB,
+						tex.rgb.data(), tex.rgb.size());
+				}
+				else
+				{
+					auto& level = tex.compressed.levels[0];
+					t = uploader.CreateTexture(level.width, level.height,
+						TextureCompressor::ToTextureFormat(tex.compressed.format), level.data.data(), level.data.size());
+				}
+				tex_mgr.Add(tex.name, t, tex.hash, tex.width, tex.height, tex.Bytes());
+
+				QUAKE_PROFILE_COUNTER(Textures, 1);
+				QUAKE_PROFILE_COUNTER(BytesUploaded, tex.Bytes());
+			}
+			tex = WadFileLoader::DecodedTexture();
+		}
+		++m_upload_tex;
+		++m_tex_uploaded;
+
+		if (std::chrono::steady_clock::now() - start >= budget) {
+			return m_status;
+		}
+	}
+
+	m_parser->UpdateFaceTextures(m_ctx);
+	if (m_params.create_lightmaps) {
+		m_ctx.GetLightmaps().CreatetTextures(uploader);
+	}
+
+	m_status = Status::Done;
+	return m_status;
+}
+
+float MapLoader::GetProgress() const
+{
+	switch (m_status)
+	{
+	case Status::Idle:
+		return 0;
+	case Status::Done:
+		return 1;
+	default:
+		break;
+	}
+
+	const float parse = m_status == Status::Running ? 0.0f : 1.0f;
+
+	const size_t wads_total = m_wads_total;
+	const float decode = wads_total == 0 ? parse :
+		static_cast<float>(m_wads_decoded) / wads_total;
+
+	const size_t tex_total = m_tex_total;
+	const float upload = tex_total == 0 ? 0.0f :
+		static_cast<float>(m_tex_uploaded) / tex_total;
+
+	return parse * 0.4f + decode * 0.3f + upload * 0.3f;
+}
+
+std::string MapLoader::GetError() const
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_error;
+}
+
+size_t MapLoader::GetDecodedBytes() const
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+
+	size_t bytes = 0;
+	for (auto& wad : m_wads)
+	{
+		bytes += MemoryBytes::Vector(wad.textures);
+		for (auto& tex : wad.textures)
+		{
+			bytes += MemoryBytes::String(tex.name) + MemoryBytes::Vector(tex.rgb);
+			for (auto& level : tex.compressed.levels) {
+				bytes += MemoryBytes::Vector(level.data);
+			}
+		}
+	}
+	return bytes;
+}
+
+void MapLoader::ParseTask()
+{
+	QUAKE_PROFILE_SCOPE("MapLoader::ParseTask");
+
+	const char* begin = nullptr;
+	const char* end   = nullptr;
+	if (m_params.paks)
+	{
+		auto file = m_params.paks->Find(m_params.map_filepath);
+		if (!file.Empty()) {
+			begin = reinterpret_cast<const char*>(file.data);
+			end   = begin + file.size;
+		}
+	}
+	if (!begin)
+	{
+		if (!ReadFile(m_params.map_filepath, m_map_data)) {
+			Fail("Can't open map: " + m_params.map_filepath);
+			return;
+		}
+		begin = m_map_data.data();
+		end   = begin + m_map_data.size();
+	}
+
+	SubmitWads(ScanWadKey(begin, end));
+
+	try
+	{
+		auto parser = std::make_unique<MapParser>(begin, end);
+		parser->SetCancelFlag(&m_cancel);
+		parser->Parse();
+		m_parser = std::move(parser);
+	}
+	catch (const std::exception& e)
+	{
+		Fail(std::string("Parse error: ") + e.what());
+		return;
+	}
+
+	if (m_cancel) {
+		m_status = Status::Cancelled;
+	} else {
+		Status expected = Status::Running;
+		m_status.compare_exchange_strong(expected, Status::Uploading);
+	}
+}
+
+void MapLoader::DecodeTask(const std::string& wad_path, size_t wad_idx)
+{
+	QUAKE_PROFILE_SCOPE("MapLoader::DecodeTask");
+
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+
+	std::vector<unsigned char> buf;
+
+	namespace fs = boost::filesystem;
+	const auto filename = fs::path(wad_path).filename().string();
+	if (m_params.paks)
+	{
+		auto file = m_params.paks->Find(wad_path);
+		if (file.Empty()) {
+			file = m_params.paks->Find(filename);
+		}
+		if (!file.Empty()) {
+			data = file.data;
+			size = file.size;
+		}
+	}
+	if (!data)
+	{
+		const std::string candidates[] = {
+			wad_path,
+			(fs::path(m_params.base_dir) / wad_path).string(),
+			(fs::path(m_params.base_dir) / filename).string(),
+		};
+		for (auto& path : candidates) {
+			if (ReadFile(path, buf)) {
+				data = buf.data();
+				size = buf.size();
+				break;
+			}
+		}
+	}
+
+	// a missing wad leaves its textures unresolved, as UpdateFaceTextures reports
+	std::vector<WadFileLoader::DecodedTexture> textures;
+	if (data)
+	{
+		WadFileLoader loader(m_palette, m_ctx);
+		if (m_params.compress_textures) {
+			loader.EnableCompression(m_params.compression, m_params.texture_cache);
+		}
+		auto need_pixels = [this](uint64_t hash) {
+			std::lock_guard<std::mutex> lock(m_mtx);
+			return m_claimed.insert(hash).second;
+		};
+		if (!loader.Decode(data, size, textures, &m_cancel, need_pixels)) {
+			textures.clear();
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_tex_total += textures.size();
+	m_wads[wad_idx].textures.swap(textures);
+	m_wads[wad_idx].done = true;
+	++m_wads_decoded;
+}
+
+bool MapLoader::TakePixels(uint64_t hash, size_t wad_idx, WadFileLoader::DecodedTexture& tex)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	for (size_t i = wad_idx + 1, n = m_wads.size(); i < n; ++i)
+	{
+		for (auto& src : m_wads[i].textures)
+		{
+			if (src.hash == hash && !src.Empty())
+			{
+				// the later copy finds the upload by its hash
+				tex.rgb.swap(src.rgb);
+				std::swap(tex.compressed, src.compressed);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void MapLoader::SubmitWads(const std::string& wad_key)
+{
+	std::vector<std::string> paths;
+
+	size_t begin = 0;
+	while (begin < wad_key.size())
+	{
+		auto end = wad_key.find(';', begin);
+		if (end == std::string::npos) {
+			end = wad_key.size();
+		}
+
+		auto path = wad_key.substr(begin, end - begin);
+		// keys written by editors often start with a slash, eg. "/gfx/base.wad"
+		while (!path.empty() && (path.front() == '/' || path.front() == '\\')) {
+			path.erase(path.begin());
+		}
+		if (!path.empty()) {
+			paths.push_back(path);
+		}
+
+		begin = end + 1;
+	}
+
+	// sized before any task runs, Update() only reads it once parsing is done
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_wads.resize(paths.size());
+	}
+	m_wads_total = paths.size();
+
+	for (size_t i = 0, n = paths.size(); i < n; ++i)
+	{
+		auto path = paths[i];
+		auto future = m_pool.Submit([this, path, i]() { DecodeTask(path, i); });
+
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_wad_futures.push_back(std::move(future));
+	}
+}
+
+void MapLoader::Fail(const std::string& msg)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_error = msg;
+	}
+	m_status = Status::Failed;
+}
+
+void MapLoader::WaitAll()
+{
+	if (m_parse_future.valid()) {
+		m_parse_future.wait();
+	}
+
+	// no new wad tasks once the parse task is over, the decode tasks
+	// take m_mtx themselves so wait outside of it
+	std::vector<std::future<void>> wads;
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		wads.swap(m_wad_futures);
+	}
+	for (auto& f : wads) {
+		if (f.valid()) {
+			f.wait();
+		}
+	}
+}
+
+}
@@ -0,0 +1,284 @@
+#include "quake/MapMeshCompiler.h"
+#include "quake/BrushFaces.h"
+#include "quake/TextureManager.h"
+#include "quake/ParallelFor.h"
+#include "quake/Profiler.h"
+#include "quake/SurfaceFlags.h"
+
+#include <polymesh3/Polytope.h>
+
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+namespace
+{
+
+struct Batch
+{
+	std::vector<quake::MapMesh::Vertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+typedef std::unordered_map<std::string, Batch> TexBatches;
+
+struct WeldKey
+{
+	int32_t v[8];
+
+	bool operator == (const WeldKey& key) const {
+		return memcmp(v, key.v, sizeof(v)) == 0;
+	}
+};
+
+struct WeldKeyHash
+{
+	size_t operator () (const WeldKey& key) const
+	{
+		uint64_t h = 0xcbf29ce484222325ull;
+		for (int i = 0; i < 8; ++i) {
+			h ^= static_cast<uint32_t>(key.v[i]);
+			h *= 0x100000001b3ull;
+		}
+		return static_cast<size_t>(h);
+	}
+};
+
+WeldKey MakeWeldKey(const quake::MapMesh::Vertex& v)
+{
+	WeldKey key;
+	for (int i = 0; i < 3; ++i) {
+		key.v[i] = static_cast<int32_t>(floorf(v.pos[i] * 256.0f + 0.5f));
+	}
+	for (int i = 0; i < 3; ++i) {
+		key.v[3 + i] = static_cast<int32_t>(floorf(v.normal[i] * 1024.0f + 0.5f));
+	}
+	for (int i = 0; i < 2; ++i) {
+		key.v[6 + i] = static_cast<int32_t>(floorf(v.uv[i] * 4096.0f + 0.5f));
+	}
+	return key;
+}
+
+void WeldBatch(Batch& batch)
+{
+	std::unordered_map<WeldKey, uint32_t, WeldKeyHash> key2idx;
+	key2idx.reserve(batch.vertices.size());
+
+	std::vector<quake::MapMesh::Vertex> vertices;
+	std::vector<uint32_t> remap(batch.vertices.size());
+	for (size_t i = 0, n = batch.vertices.size(); i < n; ++i)
+	{
+		auto& v = batch.vertices[i];
+		auto itr = key2idx.insert({ MakeWeldKey(v), static_cast<uint32_t>(vertices.size()) });
+		if (itr.second) {
+			vertices.push_back(v);
+		}
+		remap[i] = itr.first->second;
+	}
+
+	for (auto& i : batch.indices) {
+		i = remap[i];
+	}
+	batch.vertices.swap(vertices);
+}
+
+}
+
+namespace quake
+{
+
+MapMeshCompiler::MapMeshCompiler(const MapContext& ctx)
+	: m_ctx(ctx)
+{
+}
+
+void MapMeshCompiler::Compile(const std::vector<std::shared_ptr<MapEntity>>& entities, MapMesh& mesh)
+{
+	ProfileBind bind(&m_ctx.GetProfiler());
+
+	mesh.vertices.clear();
+	mesh.indices.clear();
+	mesh.ranges.clear();
+
+	std::vector<const pm3::Polytope*> brushes;
+	std::vector<const FaceSurface*> surfaces;
+	std::vector<const sm::vec3*> tex_axes;
+	std::vector<int> groups;
+	for (size_t i = 0, n = entities.size(); i < n; ++i)
+	{
+		auto& e = entities[i];
+		for (size_t j = 0, m = e->brushes.size(); j < m; ++j)
+		{
+			if (e->brushes[j]) {
+				// indexed by BrushFace::index
+				assert(!e->GetSurfaces(j) || e->GetSurfaceCount(j) == e->brushes[j]->Faces().size());
+				brushes.push_back(e->brushes[j].get());
+				surfaces.push_back(e->GetSurfaces(j));
+				tex_axes.push_back(e->GetTexAxes(j));
+				groups.push_back(static_cast<int>(i));
+			}
+		}
+	}
+
+	std::vector<std::vector<BrushFace>> brush_faces(brushes.size());
+	ParallelFor(brushes.size(), 64, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			BuildBrushFaces(*brushes[i], brush_faces[i], surfaces[i]);
+		}
+	});
+
+	// on whole brushes, one with an invisible face hides nothing
+	m_hidden_face_stats = HiddenFaceRemoval::Stats();
+	if (m_remove_hidden_faces) {
+		m_hidden_face_stats = HiddenFaceRemoval::Run(groups, brush_faces);
+	}
+
+	if (m_skip_invisible_faces)
+	{
+		auto is_invisible = [](const BrushFace& f) {
+			return !f.surface.IsDrawn();
+		};
+		for (auto& faces : brush_faces) {
+			faces.erase(std::remove_if(faces.begin(), faces.end(), is_invisible), faces.end());
+		}
+	}
+
+	auto& tex_mgr = m_ctx.GetTextures();
+
+	// triangulate in parallel, each chunk into its own per texture batches
+	std::vector<std::pair<size_t, TexBatches>> chunks;
+	std::mutex chunks_mtx;
+	ParallelFor(brushes.size(), 64, [&](size_t begin, size_t end)
+	{
+		TexBatches batches;
+		std::unordered_map<std::string, std::pair<float, float>> tex_sizes;
+		for (size_t i = begin; i < end; ++i)
+		{
+			for (auto& f : brush_faces[i])
+			{
+				auto& tex_map = f.face->tex_map;
+
+				auto size_itr = tex_sizes.find(tex_map.tex_name);
+				if (size_itr == tex_sizes.end())
+				{
+					std::pair<float, float> size(1.0f, 1.0f);
+					int w, h;
+					if (tex_mgr.QuerySize(tex_map.tex_name, w, h) && w > 0 && h > 0) {
+						size.first  = static_cast<float>(w);
+						size.second = static_cast<float>(h);
+					}
+					size_itr = tex_sizes.insert({ tex_map.tex_name, size }).first;
+				}
+
+				// valve 220 faces project along their own axes, the rest
+				// along quake's axis aligned ones
+				sm::vec3 s_axis, t_axis;
+				if (tex_axes[i])
+				{
+					const float sx = tex_map.scale.x != 0 ? tex_map.scale.x : 1.0f;
+					const float sy = tex_map.scale.y != 0 ? tex_map.scale.y : 1.0f;
+					s_axis = tex_axes[i][f.index * 2] / sx;
+					t_axis = tex_axes[i][f.index * 2 + 1] / sy;
+				}
+				else
+				{
+					CalcTextureAxis(f.normal, tex_map.angle, tex_map.scale, s_axis, t_axis);
+				}
+
+				auto& batch = batches[tex_map.tex_name];
+				const uint32_t base = static_cast<uint32_t>(batch.vertices.size());
+				for (auto& p : f.vertices)
+				{
+					MapMesh::Vertex v;
+					v.pos[0] = p.x;
+					v.pos[1] = p.y;
+					v.pos[2] = p.z;
+					v.normal[0] = f.normal.x;
+					v.normal[1] = f.normal.y;
+					v.normal[2] = f.normal.z;
+					v.uv[0] = (s_axis.Dot(p) + tex_map.offset.x) / size_itr->second.first;
+					v.uv[1] = (t_axis.Dot(p) + tex_map.offset.y) / size_itr->second.second;
+					batch.vertices.push_back(v);
+				}
+				for (uint32_t j = 1, n = static_cast<uint32_t>(f.vertices.size()); j + 1 < n; ++j) {
+					batch.indices.push_back(base);
+					batch.indices.push_back(base + j);
+					batch.indices.push_back(base + j + 1);
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(chunks_mtx);
+		chunks.push_back({ begin, std::move(batches) });
+	});
+	// keep the output independent of thread timing
+	std::sort(chunks.begin(), chunks.end(), [](const std::pair<size_t, TexBatches>& a, const std::pair<size_t, TexBatches>& b) {
+		return a.first < b.first;
+	});
+
+	// merge chunks per texture, sorted by name
+	std::map<std::string, Batch> sorted;
+	for (auto& chunk : chunks) {
+		for (auto& itr : chunk.second) {
+			sorted[itr.first];
+		}
+	}
+	std::vector<std::pair<const std::string*, Batch*>> textures;
+	for (auto& itr : sorted) {
+		textures.push_back({ &itr.first, &itr.second });
+	}
+
+	ParallelFor(textures.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			auto& dst = *textures[i].second;
+			for (auto& chunk : chunks)
+			{
+				auto itr = chunk.second.find(*textures[i].first);
+				if (itr == chunk.second.end()) {
+					continue;
+				}
+				const uint32_t base = static_cast<uint32_t>(dst.vertices.size());
+				dst.vertices.insert(dst.vertices.end(), itr->second.vertices.begin(), itr->second.vertices.end());
+				for (auto idx : itr->second.indices) {
+					dst.indices.push_back(base + idx);
+				}
+			}
+			if (m_weld) {
+				WeldBatch(dst);
+			}
+		}
+	});
+
+	size_t vert_num = 0, idx_num = 0;
+	for (auto& itr : sorted) {
+		vert_num += itr.second.vertices.size();
+		idx_num  += itr.second.indices.size();
+	}
+	mesh.vertices.reserve(vert_num);
+	mesh.indices.reserve(idx_num);
+
+	for (auto& itr : sorted)
+	{
+		MapMesh::Range range;
+		range.tex_name    = itr.first;
+		range.tex         = tex_mgr.Query(itr.first);
+		range.first_index = static_cast<uint32_t>(mesh.indices.size());
+		range.index_count = static_cast<uint32_t>(itr.second.indices.size());
+		mesh.ranges.push_back(range);
+
+		const uint32_t base = static_cast<uint32_t>(mesh.vertices.size());
+		mesh.vertices.insert(mesh.vertices.end(), itr.second.vertices.begin(), itr.second.vertices.end());
+		for (auto idx : itr.second.indices) {
+			mesh.indices.push_back(base + idx);
+		}
+	}
+}
+
+}
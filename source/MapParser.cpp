@@ -1,12 +1,15 @@
 #include "quake/MapParser.h"
 #include "quake/MapAttributes.h"
 #include "quake/TextureManager.h"
+#include "quake/ParallelFor.h"
 
 #include <lexer/Exception.h>
 #include <polymesh3/Polytope.h>
 
 #include <set>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include <assert.h>
 
@@ -19,6 +22,9 @@ const std::string NoTextureName = "__TB_empty";
 
 const float SCALE = 0.01f;
 
+// brushes per batch taken by a BuildPolytopes() worker
+const size_t POLYTOPE_BATCH = 64;
+
 }
 
 namespace quake
@@ -31,7 +37,17 @@ namespace quake
 MapTokenizer::MapTokenizer(const std::string& str)
 	: lexer::Tokenizer<MapToken::Type>(str.c_str(), str.c_str() + str.length(), "\"", '\\')
 	, m_skip_eol(true)
+	, m_begin(str.c_str())
+{
+	m_index.Build(str.c_str(), str.c_str() + str.length());
+}
+
+MapTokenizer::MapTokenizer(const char* begin, const char* end)
+	: lexer::Tokenizer<MapToken::Type>(begin, end, "\"", '\\')
+	, m_skip_eol(true)
+	, m_begin(begin)
 {
+	m_index.Build(begin, end);
 }
 
 void MapTokenizer::SetSkipEol(bool skip_eol)
@@ -39,7 +55,20 @@ void MapTokenizer::SetSkipEol(bool skip_eol)
 	m_skip_eol = skip_eol;
 }
 
+MapTokenizer::Token MapTokenizer::NextToken()
+{
+#ifndef QUAKE_NO_PROFILE
+	++m_token_count;
+#endif // QUAKE_NO_PROFILE
+	return lexer::Tokenizer<MapToken::Type>::NextToken();
+}
+
 lexer::Tokenizer<MapToken::Type>::Token MapTokenizer::EmitToken()
+{
+	return ReadToken();
+}
+
+lexer::Tokenizer<MapToken::Type>::Token MapTokenizer::ReadToken()
 {
     while (!Eof())
 	{
@@ -93,23 +122,23 @@ lexer::Tokenizer<MapToken::Type>::Token MapTokenizer::EmitToken()
             case '\r':
             case ' ':
             case '\t':
-                DiscardWhile(Whitespace());
+                Advance(m_index.SkipWhitespace(c - m_begin) - (c - m_begin));
                 break;
             default: { // whitespace, integer, decimal or word
-                const char* e = ReadInteger(NumberDelim());
-				if (e != nullptr) {
-					return Token(MapToken::Integer, c, e, Offset(c), start_line, start_column);
-				}
-
-                e = ReadDecimal(NumberDelim());
-				if (e != nullptr) {
-					return Token(MapToken::Decimal, c, e, Offset(c), start_line, start_column);
+				// the same as ReadInteger(), ReadDecimal() then ReadUntil(), with
+				// the token ends taken from the index
+				const char* e = m_begin + m_index.FindNumberDelim(c - m_begin);
+				const MapToken::Type type = ClassifyNumber(c, e);
+				if (type != 0) {
+					Advance(e - c);
+					return Token(type, c, e, Offset(c), start_line, start_column);
 				}
 
-                e = ReadUntil(Whitespace());
-				if (e == nullptr) {
+				e = m_begin + m_index.FindWhitespace(c - m_begin);
+				if (e == c) {
 					throw lexer::ParserException(start_line, start_column, "Unexpected character: " + std::string(c, 1));
 				}
+				Advance(e - c);
                 return Token(MapToken::String, c, e, Offset(c), start_line, start_column);
             }
         }
@@ -117,10 +146,60 @@ lexer::Tokenizer<MapToken::Type>::Token MapTokenizer::EmitToken()
     return Token(MapToken::Eof, nullptr, nullptr, Length(), Line(), Column());
 }
 
-const std::string& MapTokenizer::NumberDelim()
+MapToken::Type MapTokenizer::ClassifyNumber(const char* begin, const char* end)
 {
-	static const std::string number_delim(Whitespace() + ")");
-	return number_delim;
+	if (begin == end) {
+		return 0;
+	}
+
+	auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+
+	// integer, a sign and at least one digit
+	const char* p = begin;
+	if (*p == '+' || *p == '-') {
+		++p;
+	}
+	if (p < end && is_digit(*p))
+	{
+		while (p < end && is_digit(*p)) {
+			++p;
+		}
+		if (p == end) {
+			return MapToken::Integer;
+		}
+	}
+
+	// decimal, sign or digit, digits, '.', digits, 'e', sign or digit, digits
+	p = begin;
+	if (*p != '+' && *p != '-' && *p != '.' && !is_digit(*p)) {
+		return 0;
+	}
+	if (*p != '.')
+	{
+		++p;
+		while (p < end && is_digit(*p)) {
+			++p;
+		}
+	}
+	if (p < end && *p == '.')
+	{
+		++p;
+		while (p < end && is_digit(*p)) {
+			++p;
+		}
+	}
+	if (p < end && *p == 'e')
+	{
+		++p;
+		if (p < end && (*p == '+' || *p == '-' || is_digit(*p)))
+		{
+			++p;
+			while (p < end && is_digit(*p)) {
+				++p;
+			}
+		}
+	}
+	return p == end ? MapToken::Decimal : 0;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -133,13 +212,40 @@ MapParser::MapParser(const std::string& str)
 {
 }
 
+MapParser::MapParser(const char* begin, const char* end)
+	: m_tokenizer(MapTokenizer(begin, end))
+	, m_format(MapFormat::Unknown)
+{
+}
+
 MapParser::~MapParser()
 {
 }
 
 void MapParser::Parse()
 {
+	QUAKE_PROFILE_SCOPE("MapParser::Parse");
+
 	ParseEntities(MapFormat::Quake2);
+
+#ifndef QUAKE_NO_PROFILE
+	if (Profiler::Current()->IsEnabled())
+	{
+		size_t brush_num = 0, face_num = 0;
+		for (auto& e : m_entities) {
+			brush_num += e->brushes.size();
+			for (auto& b : e->brushes) {
+				face_num += b->Faces().size();
+			}
+		}
+		QUAKE_PROFILE_COUNTER(Tokens, m_tokenizer.GetTokenCount());
+		QUAKE_PROFILE_COUNTER(Entities, m_entities.size());
+		QUAKE_PROFILE_COUNTER(Brushes, brush_num);
+		QUAKE_PROFILE_COUNTER(Faces, face_num);
+	}
+	QUAKE_PROFILE_TIMER_FLUSH(m_face_timer, "MapParser::ParseFace");
+	QUAKE_PROFILE_TIMER_FLUSH(m_brush_timer, "MapParser::EndBrush");
+#endif // QUAKE_NO_PROFILE
 }
 
 const std::shared_ptr<MapEntity> MapParser::GetWorldEntity() const
@@ -148,30 +254,67 @@ const std::shared_ptr<MapEntity> MapParser::GetWorldEntity() const
 		m_entities[m_world_entry_idx] : nullptr;
 }
 
-void MapParser::UpdateFaceTextures()
+void MapParser::UpdateFaceTextures(const MapContext& ctx)
 {
 	std::set<std::string> err;
 
-	auto tex_mgr = TextureManager::Instance();
+	auto& tex_mgr = ctx.GetTextures();
 	for (auto& e : m_entities) {
 		for (auto& b : e->brushes) {
 			for (auto& f : b->Faces()) {
-				tex_mgr->Query(f->tex_map.tex_name);
+				tex_mgr.Query(f->tex_map.tex_name);
 			}
 		}
 	}
 }
 
+void MapParser::EnableFaceTable(bool enable)
+{
+	if (enable) {
+		if (!m_face_table) {
+			m_face_table = std::make_shared<MapFaceTable>();
+		}
+	} else {
+		m_face_table.reset();
+	}
+}
+
+void MapParser::EnableEntityTable(bool enable)
+{
+	if (enable) {
+		if (!m_entity_table) {
+			m_entity_table = std::make_shared<MapEntityTable>();
+		}
+	} else {
+		m_entity_table.reset();
+	}
+}
+
 void MapParser::ParseEntities(MapFormat::Type format)
 {
 	SetFormat(format);
 
-	Token token = m_tokenizer.PeekToken();
-	while (token.GetType() != MapToken::Eof)
+	try
 	{
-		Expect(MapToken::OBrace, token);
-		ParseEntity();
-		token = m_tokenizer.PeekToken();
+		Token token = m_tokenizer.PeekToken();
+		while (token.GetType() != MapToken::Eof && !IsCancelled())
+		{
+			Expect(MapToken::OBrace, token);
+			ParseEntity();
+			token = m_tokenizer.PeekToken();
+		}
+	}
+	catch (...)
+	{
+		// the brushes ended before the error keep their slots
+		DiscardCurrBrush();
+		BuildPolytopes();
+		throw;
+	}
+
+	BuildPolytopes();
+	if (m_face_table) {
+		m_face_table->Compact();
 	}
 
 	// set m_world_entry_idx
@@ -181,19 +324,32 @@ void MapParser::ParseEntities(MapFormat::Type format)
 			break;
 		}
 	}
-	assert(m_world_entry_idx >= 0);
 }
 
 void MapParser::ParseBrushes(MapFormat::Type format)
 {
 	SetFormat(format);
 
-	Token token = m_tokenizer.PeekToken();
-	while (token.GetType() != MapToken::Eof)
+	try
 	{
-		Expect(MapToken::OBrace, token);
-		ParseBrush();
-		token = m_tokenizer.PeekToken();
+		Token token = m_tokenizer.PeekToken();
+		while (token.GetType() != MapToken::Eof)
+		{
+			Expect(MapToken::OBrace, token);
+			ParseBrush();
+			token = m_tokenizer.PeekToken();
+		}
+	}
+	catch (...)
+	{
+		DiscardCurrBrush();
+		BuildPolytopes();
+		throw;
+	}
+
+	BuildPolytopes();
+	if (m_face_table) {
+		m_face_table->Compact();
 	}
 }
 
@@ -210,6 +366,49 @@ void MapParser::ParseBrushFaces(MapFormat::Type format)
 	}
 }
 
+void MapParser::BuildPolytopes()
+{
+	QUAKE_PROFILE_SCOPE("MapParser::BuildPolytopes");
+
+	const size_t n = m_pending_brushes.size();
+	auto build = [this](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			auto& b = m_pending_brushes[i];
+			b.entity->brushes[b.index] = std::make_shared<pm3::Polytope>(b.faces);
+		}
+	};
+
+	// brushes differ in face count, so the workers take small batches off
+	// a shared counter instead of one fixed range each
+	const size_t threads = std::min<size_t>(std::max<size_t>(1, std::thread::hardware_concurrency()),
+		(n + POLYTOPE_BATCH - 1) / POLYTOPE_BATCH);
+	if (threads <= 1)
+	{
+		build(0, n);
+	}
+	else
+	{
+		std::atomic<size_t> next(0);
+		ParallelFor(threads, 1, [&](size_t, size_t)
+		{
+			size_t begin;
+			while ((begin = next.fetch_add(POLYTOPE_BATCH)) < n) {
+				build(begin, std::min(n, begin + POLYTOPE_BATCH));
+			}
+		});
+	}
+
+	m_pending_brushes.clear();
+}
+
+void MapParser::DiscardCurrBrush()
+{
+	m_curr_faces.clear();
+	m_curr_face_refs.clear();
+	m_curr_surfaces.clear();
+	m_curr_tex_axes.clear();
+}
+
 void MapParser::Reset()
 {
 	m_tokenizer.Reset();
@@ -219,6 +418,7 @@ void MapParser::SetFormat(MapFormat::Type format)
 {
 	assert(format != MapFormat::Unknown);
 	m_format = format;
+	m_format_checked = format == MapFormat::Valve;
 }
 
 void MapParser::ParseEntity()
@@ -342,7 +542,8 @@ void MapParser::ParseBrush()
 
 void MapParser::ParseFace()
 {
-	// todo
+	QUAKE_PROFILE_TIMER_SCOPE(m_face_timer);
+
     sm::vec3 tex_axis_x, tex_axis_y;
 
     Token token = m_tokenizer.NextToken();
@@ -374,6 +575,15 @@ void MapParser::ParseFace()
 	face->plane = sm::Plane(p1, p2, p3);
 	face->tex_map.tex_name = texture_name;
 	std::transform(face->tex_map.tex_name.begin(), face->tex_map.tex_name.end(), face->tex_map.tex_name.begin(), ::tolower);
+	// the standard and quake 2 formats continue with a number, valve 220
+	// with the bracketed texture axes
+	if (!m_format_checked)
+	{
+		if (Check(MapToken::OBracket, m_tokenizer.PeekToken())) {
+			m_format = MapFormat::Valve;
+		}
+		m_format_checked = true;
+	}
     if (m_format == MapFormat::Valve)
 	{
         Expect(MapToken::OBracket, m_tokenizer.NextToken());
@@ -403,6 +613,9 @@ void MapParser::ParseFace()
     Expect(MapToken::Integer | MapToken::Decimal, token = m_tokenizer.NextToken());
 	face->tex_map.scale.y = token.ToFloat<float>();
 
+    FaceSurface surface;
+    bool has_surface = false;
+
     // We'll be pretty lenient when parsing additional face attributes.
     if (!Check(MapToken::OParenthesis | MapToken::CBrace | MapToken::Eof, m_tokenizer.PeekToken()))
 	{
@@ -419,11 +632,15 @@ void MapParser::ParseFace()
             Expect(MapToken::Integer | MapToken::Decimal, token = m_tokenizer.NextToken());
             const float surfaceValue = token.ToFloat<float>();
 
-    //        if (m_format == MapFormat::Quake2) {
-				//face->setSurfaceContents(surfaceContents);
-				//face->setSurfaceFlags(surfaceFlags);
-				//face->setSurfaceValue(surfaceValue);
-    //        }
+			// all zero is what editors write for quake 1 maps too
+			if (surfaceContents != 0 || surfaceFlags != 0 || surfaceValue != 0)
+			{
+				// no contents means solid, as qbsp reads it
+				surface.contents = surfaceContents != 0 ? static_cast<uint32_t>(surfaceContents) : ContentFlags::Solid;
+				surface.flags    = static_cast<uint32_t>(surfaceFlags);
+				surface.value    = static_cast<int32_t>(surfaceValue);
+				has_surface = true;
+			}
         }
 		else
 		{
@@ -432,13 +649,31 @@ void MapParser::ParseFace()
         }
     }
 
+    if (!has_surface) {
+        surface = GetTextureSurface(face->tex_map.tex_name);
+    }
+
     const sm::vec3 normal = (p2 - p1).Cross(p3 - p1).Normalized();
 	if (fabs(normal.x) < FLT_EPSILON &&
 		fabs(normal.y) < FLT_EPSILON &&
 		fabs(normal.z) < FLT_EPSILON) {
 //		status.error(line, column, "Skipping face: face points are colinear");
 	} else {
+		if (m_face_table)
+		{
+			MapFaceTable::Face ref;
+			ref.plane = m_face_table->AddPlane(face->plane);
+			const uint32_t tex = m_face_table->AddTexture(face->tex_map.tex_name);
+			ref.texinfo = m_face_table->AddTexInfo(tex, face->tex_map.offset,
+				face->tex_map.angle, face->tex_map.scale);
+			m_curr_face_refs.push_back(ref);
+		}
 		m_curr_faces.push_back(face);
+		m_curr_surfaces.push_back(surface);
+		if (m_format == MapFormat::Valve) {
+			m_curr_tex_axes.push_back(tex_axis_x);
+			m_curr_tex_axes.push_back(tex_axis_y);
+		}
 	}
 }
 
@@ -521,6 +756,13 @@ void MapParser::BeginEntity(size_t line, const std::vector<EntityAttribute>& att
 	m_entities.push_back(m_curr_entity);
 
 	m_curr_entity->attributes = attributes;
+
+	auto& classname = FindAttribute(attributes, AttributeNames::Classname);
+	m_curr_entity_trigger = classname.compare(0, 8, "trigger_") == 0;
+
+	if (m_entity_table) {
+		m_entity_table->AddEntity(attributes);
+	}
 }
 
 void MapParser::EndEntity(size_t start_line, size_t line_count)
@@ -538,9 +780,47 @@ void MapParser::BeginBrush(size_t line)
 void MapParser::EndBrush(size_t start_line, size_t line_count,
 	                     const std::map<std::string, ExtraAttribute>& extra_attributes)
 {
-    auto poly = std::make_shared<pm3::Polytope>(m_curr_faces);
-	m_curr_entity->brushes.emplace_back(poly);
+	QUAKE_PROFILE_TIMER_SCOPE(m_brush_timer);
+
+	if (!m_brush_geometry)
+	{
+		for (auto& f : m_curr_faces) {
+			++m_texture_usage[f->tex_map.tex_name];
+		}
+		DiscardCurrBrush();
+		return;
+	}
+
+	uint32_t contents = 0;
+	bool drawn = false;
+	for (auto& s : m_curr_surfaces) {
+		contents |= s.contents;
+		drawn = drawn || s.IsDrawn();
+	}
+	const bool trigger = m_curr_entity_trigger || (contents & ContentFlags::Trigger) != 0;
+	if ((m_drop_triggers && trigger) || (m_drop_invisible && !drawn && !m_curr_surfaces.empty()))
+	{
+		++m_dropped_brushes;
+		DiscardCurrBrush();
+		return;
+	}
+
+	// built by BuildPolytopes()
+	m_pending_brushes.push_back({ m_curr_entity.get(), m_curr_entity->brushes.size(), std::move(m_curr_faces) });
+	m_curr_entity->brushes.emplace_back(nullptr);
+	m_curr_entity->surface_offsets.push_back(static_cast<uint32_t>(m_curr_entity->surfaces.size()));
+	m_curr_entity->surfaces.insert(m_curr_entity->surfaces.end(), m_curr_surfaces.begin(), m_curr_surfaces.end());
+	m_curr_entity->tex_axes.insert(m_curr_entity->tex_axes.end(), m_curr_tex_axes.begin(), m_curr_tex_axes.end());
 	m_curr_faces.clear();
+	m_curr_surfaces.clear();
+	m_curr_tex_axes.clear();
+
+	if (m_face_table)
+	{
+		m_face_table->AddBrush(static_cast<uint32_t>(m_entities.size() - 1),
+			static_cast<uint32_t>(m_curr_entity->brushes.size() - 1), m_curr_face_refs);
+		m_curr_face_refs.clear();
+	}
 }
 
 MapParser::EntityType MapParser::GetEntityType(const std::vector<EntityAttribute>& attributes) const
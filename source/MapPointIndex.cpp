@@ -0,0 +1,274 @@
+#include "quake/MapPointIndex.h"
+#include "quake/MapEntityTable.h"
+#include "quake/ParallelFor.h"
+#include "quake/Profiler.h"
+
+#include <algorithm>
+
+namespace
+{
+
+// ranges this small are scanned instead of split
+const size_t LEAF_SIZE = 8;
+
+inline float Dist2(const float* a, const float* b)
+{
+	const float dx = a[0] - b[0];
+	const float dy = a[1] - b[1];
+	const float dz = a[2] - b[2];
+	return dx * dx + dy * dy + dz * dz;
+}
+
+bool MatchClassname(const std::string& name, const std::vector<std::string>& patterns)
+{
+	for (auto& p : patterns)
+	{
+		if (!p.empty() && p.back() == '*') {
+			if (name.compare(0, p.size() - 1, p, 0, p.size() - 1) == 0) {
+				return true;
+			}
+		} else if (name == p) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool NeighborLess(const quake::MapPointIndex::Neighbor& a, const quake::MapPointIndex::Neighbor& b)
+{
+	return a.dist2 < b.dist2;
+}
+
+}
+
+namespace quake
+{
+
+void MapPointIndex::Build(const MapEntityTable& table, const std::vector<std::string>& classnames)
+{
+	QUAKE_PROFILE_SCOPE("MapPointIndex::Build");
+
+	Clear();
+
+	// match the interned names once, not every entity
+	auto& names = table.GetNames();
+	std::vector<bool> name_ok(names.size(), classnames.empty());
+	if (!classnames.empty()) {
+		for (size_t i = 0, n = names.size(); i < n; ++i) {
+			name_ok[i] = MatchClassname(names[i], classnames);
+		}
+	}
+
+	auto& ids = table.GetClassnames();
+	for (size_t i = 0, n = table.Size(); i < n; ++i)
+	{
+		if (!table.HasOrigin(i)) {
+			continue;
+		}
+		const uint32_t id = ids[i];
+		if (id == MapEntityTable::NO_NAME ? !classnames.empty() : !name_ok[id]) {
+			continue;
+		}
+
+		Point p;
+		p.pos[0] = table.GetOriginsX()[i];
+		p.pos[1] = table.GetOriginsY()[i];
+		p.pos[2] = table.GetOriginsZ()[i];
+		p.entity = static_cast<uint32_t>(i);
+		m_points.push_back(p);
+	}
+
+	m_axes.resize(m_points.size(), 0);
+	BuildRecursive(0, m_points.size());
+}
+
+void MapPointIndex::Clear()
+{
+	m_points.clear();
+	m_axes.clear();
+}
+
+void MapPointIndex::QueryRadius(const sm::vec3& center, float radius, std::vector<uint32_t>& entities) const
+{
+	const float c[3] = { center.x, center.y, center.z };
+	QueryRadiusRecursive(0, m_points.size(), c, radius * radius, entities);
+}
+
+void MapPointIndex::QueryBox(const sm::vec3& min, const sm::vec3& max, std::vector<uint32_t>& entities) const
+{
+	const float b_min[3] = { min.x, min.y, min.z };
+	const float b_max[3] = { max.x, max.y, max.z };
+	QueryBoxRecursive(0, m_points.size(), b_min, b_max, entities);
+}
+
+size_t MapPointIndex::QueryNearest(const sm::vec3& pos, size_t k, Neighbor* out, float max_dist) const
+{
+	if (k == 0) {
+		return 0;
+	}
+
+	// out is a max heap on the distance until the end
+	const float p[3] = { pos.x, pos.y, pos.z };
+	size_t count = 0;
+	float worst2 = max_dist * max_dist;
+	QueryNearestRecursive(0, m_points.size(), p, k, out, count, worst2);
+
+	std::sort_heap(out, out + count, NeighborLess);
+	return count;
+}
+
+void MapPointIndex::QueryNearestBatch(const sm::vec3* pos, size_t count, size_t k, Neighbor* out,
+	                                  size_t* found, float max_dist) const
+{
+	ParallelFor(count, 256, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			found[i] = QueryNearest(pos[i], k, out + i * k, max_dist);
+		}
+	});
+}
+
+void MapPointIndex::BuildRecursive(size_t begin, size_t end)
+{
+	if (end - begin <= LEAF_SIZE) {
+		return;
+	}
+
+	float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (size_t i = begin; i < end; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			min[j] = std::min(min[j], m_points[i].pos[j]);
+			max[j] = std::max(max[j], m_points[i].pos[j]);
+		}
+	}
+	int axis = 0;
+	for (int j = 1; j < 3; ++j) {
+		if (max[j] - min[j] > max[axis] - min[axis]) {
+			axis = j;
+		}
+	}
+
+	const size_t mid = begin + (end - begin) / 2;
+	std::nth_element(m_points.begin() + begin, m_points.begin() + mid, m_points.begin() + end,
+		[axis](const Point& a, const Point& b) { return a.pos[axis] < b.pos[axis]; });
+	m_axes[mid] = static_cast<uint8_t>(axis);
+
+	BuildRecursive(begin, mid);
+	BuildRecursive(mid + 1, end);
+}
+
+void MapPointIndex::QueryRadiusRecursive(size_t begin, size_t end, const float* center, float radius2,
+	                                     std::vector<uint32_t>& entities) const
+{
+	if (end - begin <= LEAF_SIZE)
+	{
+		for (size_t i = begin; i < end; ++i) {
+			if (Dist2(m_points[i].pos, center) <= radius2) {
+				entities.push_back(m_points[i].entity);
+			}
+		}
+		return;
+	}
+
+	const size_t mid = begin + (end - begin) / 2;
+	auto& p = m_points[mid];
+	if (Dist2(p.pos, center) <= radius2) {
+		entities.push_back(p.entity);
+	}
+
+	const float d = center[m_axes[mid]] - p.pos[m_axes[mid]];
+	if (d <= 0 || d * d <= radius2) {
+		QueryRadiusRecursive(begin, mid, center, radius2, entities);
+	}
+	if (d >= 0 || d * d <= radius2) {
+		QueryRadiusRecursive(mid + 1, end, center, radius2, entities);
+	}
+}
+
+void MapPointIndex::QueryBoxRecursive(size_t begin, size_t end, const float* min, const float* max,
+	                                  std::vector<uint32_t>& entities) const
+{
+	auto inside = [min, max](const float* pos) {
+		return pos[0] >= min[0] && pos[0] <= max[0] &&
+			   pos[1] >= min[1] && pos[1] <= max[1] &&
+			   pos[2] >= min[2] && pos[2] <= max[2];
+	};
+
+	if (end - begin <= LEAF_SIZE)
+	{
+		for (size_t i = begin; i < end; ++i) {
+			if (inside(m_points[i].pos)) {
+				entities.push_back(m_points[i].entity);
+			}
+		}
+		return;
+	}
+
+	const size_t mid = begin + (end - begin) / 2;
+	auto& p = m_points[mid];
+	if (inside(p.pos)) {
+		entities.push_back(p.entity);
+	}
+
+	const int axis = m_axes[mid];
+	if (min[axis] <= p.pos[axis]) {
+		QueryBoxRecursive(begin, mid, min, max, entities);
+	}
+	if (max[axis] >= p.pos[axis]) {
+		QueryBoxRecursive(mid + 1, end, min, max, entities);
+	}
+}
+
+void MapPointIndex::QueryNearestRecursive(size_t begin, size_t end, const float* pos, size_t k,
+	                                      Neighbor* heap, size_t& count, float& worst2) const
+{
+	auto visit = [&](const Point& p)
+	{
+		const float d2 = Dist2(p.pos, pos);
+		if (d2 > worst2) {
+			return;
+		}
+
+		if (count == k) {
+			std::pop_heap(heap, heap + count, NeighborLess);
+			--count;
+		}
+		heap[count++] = { p.entity, d2 };
+		std::push_heap(heap, heap + count, NeighborLess);
+		if (count == k) {
+			worst2 = heap[0].dist2;
+		}
+	};
+
+	if (end - begin <= LEAF_SIZE)
+	{
+		for (size_t i = begin; i < end; ++i) {
+			visit(m_points[i]);
+		}
+		return;
+	}
+
+	const size_t mid = begin + (end - begin) / 2;
+	visit(m_points[mid]);
+
+	// the side of pos first, the other only if the split plane is closer
+	// than the worst of the k found
+	const int axis = m_axes[mid];
+	const float d = pos[axis] - m_points[mid].pos[axis];
+	if (d < 0)
+	{
+		QueryNearestRecursive(begin, mid, pos, k, heap, count, worst2);
+		if (d * d <= worst2) {
+			QueryNearestRecursive(mid + 1, end, pos, k, heap, count, worst2);
+		}
+	}
+	else
+	{
+		QueryNearestRecursive(mid + 1, end, pos, k, heap, count, worst2);
+		if (d * d <= worst2) {
+			QueryNearestRecursive(begin, mid, pos, k, heap, count, worst2);
+		}
+	}
+}
+
+}
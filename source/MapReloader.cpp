@@ -0,0 +1,248 @@
+#include "quake/MapReloader.h"
+#include "quake/MapParser.h"
+#include "quake/MapAttributes.h"
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace
+{
+
+struct EntitySpan
+{
+	const char* begin;
+	const char* end;
+};
+
+bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// The same rules as MapTokenizer: every brace outside of quoted strings,
+// comments and texture names is a token, "}{" or {"classname" too. The
+// texture name is the word after a face's third ')', it may start with a
+// brace, eg. "{grate".
+void SplitEntities(const char* begin, const char* end, std::vector<EntitySpan>& spans)
+{
+	int depth = 0;
+	int parens = 0;
+	const char* start = nullptr;
+	for (const char* c = begin; c < end; ++c)
+	{
+		switch (*c)
+		{
+		case '"':
+			for (++c; c < end && *c != '"'; ++c) {
+				if (*c == '\\' && c + 1 < end) {
+					++c;
+				}
+			}
+			break;
+		case '/':
+			if (c + 1 < end && c[1] == '/') {
+				while (c < end && *c != '\n') {
+					++c;
+				}
+			}
+			break;
+		case ')':
+			if (depth > 1 && ++parens == 3)
+			{
+				parens = 0;
+				for (++c; c < end && IsSpace(*c); ++c) {
+				}
+				while (c < end && !IsSpace(*c)) {
+					++c;
+				}
+				--c;
+			}
+			break;
+		case '{':
+			if (depth++ == 0) {
+				start = c;
+			}
+			parens = 0;
+			break;
+		case '}':
+			if (depth > 0 && --depth == 0) {
+				spans.push_back({ start, c + 1 });
+			}
+			parens = 0;
+			break;
+		}
+	}
+}
+
+// 8 bytes per step, the split above already reads every byte once
+uint64_t HashSpan(const char* begin, const char* end)
+{
+	const uint64_t k = 0x9e3779b97f4a7c15ull;
+	uint64_t h = 0xcbf29ce484222325ull;
+	const char* c = begin;
+	for (; end - c >= 8; c += 8)
+	{
+		uint64_t w;
+		memcpy(&w, c, 8);
+		h = ((h << 5 | h >> 59) ^ w) * k;
+	}
+	uint64_t w = 0;
+	memcpy(&w, c, end - c);
+	h = ((h << 5 | h >> 59) ^ w) * k;
+	return h ^ (h >> 32);
+}
+
+}
+
+namespace quake
+{
+
+const MapReloader::Changes& MapReloader::Reload(const std::string& str)
+{
+	return Reload(str.c_str(), str.c_str() + str.size());
+}
+
+const MapReloader::Changes& MapReloader::Reload(const char* begin, const char* end)
+{
+	std::vector<EntitySpan> spans;
+	SplitEntities(begin, end, spans);
+
+	std::unordered_map<EntityKey, std::vector<size_t>, EntityKeyHash> prev;
+	for (size_t i = 0, n = m_keys.size(); i < n; ++i) {
+		prev[m_keys[i]].push_back(i);
+	}
+	// take the first one of duplicated entities
+	for (auto& itr : prev) {
+		std::reverse(itr.second.begin(), itr.second.end());
+	}
+
+	m_changes = Changes();
+
+	// null for the changed spans until they are parsed
+	std::vector<std::shared_ptr<MapEntity>> entities(spans.size());
+	std::vector<EntityKey> keys(spans.size());
+	std::vector<size_t> changed;
+	std::vector<bool> reused(m_entities.size(), false);
+	for (size_t i = 0, n = spans.size(); i < n; ++i)
+	{
+		auto& span = spans[i];
+		keys[i] = { HashSpan(span.begin, span.end), static_cast<size_t>(span.end - span.begin) };
+
+		// the same bytes as the old entity, so a hash collision can't hide an edit
+		auto itr = prev.find(keys[i]);
+		if (itr != prev.end())
+		{
+			auto& olds = itr->second;
+			auto old = std::find_if(olds.rbegin(), olds.rend(), [&](size_t idx) {
+				return memcmp(m_text.data() + m_offsets[idx], span.begin, keys[i].size) == 0;
+			});
+			if (old != olds.rend())
+			{
+				const size_t old_idx = *old;
+				olds.erase(std::next(old).base());
+				entities[i] = m_entities[old_idx];
+				reused[old_idx] = true;
+				++m_changes.reused;
+				continue;
+			}
+		}
+
+		changed.push_back(i);
+	}
+
+	// all changed spans in one run, each closed top-level brace pair is one
+	// entity so they come back in span order
+	std::vector<std::shared_ptr<MapEntity>> parsed;
+	if (!changed.empty())
+	{
+		std::string text;
+		for (auto i : changed) {
+			text.append(spans[i].begin, spans[i].end);
+			text.push_back('\n');
+		}
+		MapParser parser(text);
+		parser.Parse();
+		parsed = parser.GetAllEntities();
+	}
+	if (parsed.size() != changed.size())
+	{
+		// the split and the tokenizer disagree, one run per span
+		parsed.clear();
+		for (auto i : changed)
+		{
+			MapParser parser(spans[i].begin, spans[i].end);
+			parser.Parse();
+			auto& es = parser.GetAllEntities();
+			parsed.push_back(es.empty() ? nullptr : es.front());
+		}
+	}
+	for (size_t i = 0, n = changed.size(); i < n; ++i) {
+		entities[changed[i]] = parsed[i];
+	}
+
+	// a span which parses to no entity leaves no slot
+	std::vector<size_t> offsets;
+	offsets.reserve(spans.size());
+	size_t dst = 0;
+	for (size_t i = 0, j = 0, n = spans.size(); i < n; ++i)
+	{
+		if (j < changed.size() && changed[j] == i)
+		{
+			++j;
+			if (entities[i]) {
+				m_changes.parsed.push_back(dst);
+			}
+		}
+		if (entities[i])
+		{
+			entities[dst] = entities[i];
+			keys[dst]     = keys[i];
+			offsets.push_back(static_cast<size_t>(spans[i].begin - begin));
+			++dst;
+		}
+	}
+	entities.resize(dst);
+	keys.resize(dst);
+
+	for (size_t i = 0, n = m_entities.size(); i < n; ++i) {
+		if (!reused[i]) {
+			m_changes.removed.push_back(m_entities[i]);
+		}
+	}
+
+	m_entities.swap(entities);
+	m_keys.swap(keys);
+	m_offsets.swap(offsets);
+	m_text.assign(begin, end);
+
+	m_world_entry_idx = -1;
+	for (int i = 0, n = m_entities.size(); i < n; ++i)
+	{
+		auto& attrs = m_entities[i]->attributes;
+		if (IsWorldspawn(FindAttribute(attrs, AttributeNames::Classname), attrs)) {
+			m_world_entry_idx = i;
+			break;
+		}
+	}
+
+	return m_changes;
+}
+
+void MapReloader::Clear()
+{
+	m_entities.clear();
+	m_keys.clear();
+	m_offsets.clear();
+	m_text.clear();
+	m_world_entry_idx = -1;
+	m_changes = Changes();
+}
+
+const std::shared_ptr<MapEntity> MapReloader::GetWorldEntity() const
+{
+	return m_world_entry_idx >= 0 ?
+		m_entities[m_world_entry_idx] : nullptr;
+}
+
+}
@@ -0,0 +1,190 @@
+#include "quake/MapScanIndex.h"
+#include "quake/ParallelFor.h"
+#include "quake/SIMD.h"
+#include "quake/Profiler.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+namespace
+{
+
+const size_t BLOCK_SIZE = 64;
+
+// blocks per task, 1MB of input
+const size_t BUILD_GRAIN = (1 << 20) / BLOCK_SIZE;
+
+inline int CountTrailingZeros(uint64_t x)
+{
+#if defined(_M_X64) || defined(_M_ARM64)
+	unsigned long idx;
+	_BitScanForward64(&idx, x);
+	return static_cast<int>(idx);
+#elif defined(_MSC_VER)
+	// no 64 bit scan on x86, the low half first
+	unsigned long idx;
+	if (_BitScanForward(&idx, static_cast<uint32_t>(x))) {
+		return static_cast<int>(idx);
+	}
+	_BitScanForward(&idx, static_cast<uint32_t>(x >> 32));
+	return static_cast<int>(idx) + 32;
+#else
+	return __builtin_ctzll(x);
+#endif // _MSC_VER
+}
+
+inline bool IsWhitespace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+void ClassifyScalar(const char* data, size_t size, uint64_t& ws, uint64_t& delim)
+{
+	ws = delim = 0;
+	for (size_t i = 0; i < size; ++i)
+	{
+		if (IsWhitespace(data[i])) {
+			ws |= uint64_t(1) << i;
+			delim |= uint64_t(1) << i;
+		} else if (data[i] == ')') {
+			delim |= uint64_t(1) << i;
+		}
+	}
+}
+
+#if defined(QUAKE_SIMD_AVX2)
+
+void ClassifyBlock(const char* data, uint64_t& ws, uint64_t& delim)
+{
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i tab   = _mm256_set1_epi8('\t');
+	const __m256i lf    = _mm256_set1_epi8('\n');
+	const __m256i cr    = _mm256_set1_epi8('\r');
+	const __m256i paren = _mm256_set1_epi8(')');
+
+	ws = delim = 0;
+	for (int i = 0; i < 2; ++i)
+	{
+		const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i * 32));
+		const __m256i w = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(x, space), _mm256_cmpeq_epi8(x, tab)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(x, lf), _mm256_cmpeq_epi8(x, cr)));
+		const __m256i d = _mm256_or_si256(w, _mm256_cmpeq_epi8(x, paren));
+		ws    |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(w))) << (i * 32);
+		delim |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(d))) << (i * 32);
+	}
+}
+
+#elif defined(QUAKE_SIMD_SSE2)
+
+void ClassifyBlock(const char* data, uint64_t& ws, uint64_t& delim)
+{
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab   = _mm_set1_epi8('\t');
+	const __m128i lf    = _mm_set1_epi8('\n');
+	const __m128i cr    = _mm_set1_epi8('\r');
+	const __m128i paren = _mm_set1_epi8(')');
+
+	ws = delim = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 16));
+		const __m128i w = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(x, space), _mm_cmpeq_epi8(x, tab)),
+			_mm_or_si128(_mm_cmpeq_epi8(x, lf), _mm_cmpeq_epi8(x, cr)));
+		const __m128i d = _mm_or_si128(w, _mm_cmpeq_epi8(x, paren));
+		ws    |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(w))) << (i * 16);
+		delim |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(d))) << (i * 16);
+	}
+}
+
+#else
+
+void ClassifyBlock(const char* data, uint64_t& ws, uint64_t& delim)
+{
+	ClassifyScalar(data, BLOCK_SIZE, ws, delim);
+}
+
+#endif
+
+}
+
+namespace quake
+{
+
+void MapScanIndex::Build(const char* begin, const char* end)
+{
+	QUAKE_PROFILE_SCOPE("MapScanIndex::Build");
+
+	m_size = end - begin;
+
+	const size_t full = m_size / BLOCK_SIZE;
+	const size_t blocks = (m_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	m_whitespace.resize(blocks);
+	m_number_delim.resize(blocks);
+
+	ParallelFor(full, BUILD_GRAIN, [&](size_t b_begin, size_t b_end) {
+		for (size_t i = b_begin; i < b_end; ++i) {
+			ClassifyBlock(begin + i * BLOCK_SIZE, m_whitespace[i], m_number_delim[i]);
+		}
+	});
+	if (full < blocks) {
+		ClassifyScalar(begin + full * BLOCK_SIZE, m_size - full * BLOCK_SIZE,
+			m_whitespace[full], m_number_delim[full]);
+	}
+}
+
+size_t MapScanIndex::SkipWhitespace(size_t pos) const
+{
+	return FindClear(m_whitespace, pos);
+}
+
+size_t MapScanIndex::FindWhitespace(size_t pos) const
+{
+	return FindSet(m_whitespace, pos);
+}
+
+size_t MapScanIndex::FindNumberDelim(size_t pos) const
+{
+	return FindSet(m_number_delim, pos);
+}
+
+size_t MapScanIndex::FindSet(const std::vector<uint64_t>& bits, size_t pos) const
+{
+	if (pos >= m_size) {
+		return m_size;
+	}
+
+	size_t block = pos / BLOCK_SIZE;
+	uint64_t mask = bits[block] & (~uint64_t(0) << (pos % BLOCK_SIZE));
+	while (mask == 0)
+	{
+		if (++block == bits.size()) {
+			return m_size;
+		}
+		mask = bits[block];
+	}
+	return std::min(m_size, block * BLOCK_SIZE + CountTrailingZeros(mask));
+}
+
+size_t MapScanIndex::FindClear(const std::vector<uint64_t>& bits, size_t pos) const
+{
+	if (pos >= m_size) {
+		return m_size;
+	}
+
+	size_t block = pos / BLOCK_SIZE;
+	uint64_t mask = ~bits[block] & (~uint64_t(0) << (pos % BLOCK_SIZE));
+	while (mask == 0)
+	{
+		if (++block == bits.size()) {
+			return m_size;
+		}
+		mask = ~bits[block];
+	}
+	// bits past the end of the last block are clear, so clamp
+	return std::min(m_size, block * BLOCK_SIZE + CountTrailingZeros(mask));
+}
+
+}
@@ -0,0 +1,525 @@
+#include "quake/MapSpatialIndex.h"
+#include "quake/ParallelFor.h"
+#include "quake/SIMD.h"
+
+#include <polymesh3/Polytope.h>
+
+#include <future>
+#include <algorithm>
+
+#include <assert.h>
+
+namespace
+{
+
+const uint32_t MAX_LEAF_SIZE = 4;
+const int      SAH_BINS      = 12;
+
+// subtrees with more brushes than this are built on their own thread
+const uint32_t PARALLEL_BUILD_MIN   = 4096;
+const int      PARALLEL_BUILD_DEPTH = 3;
+
+struct Bounds
+{
+	float min[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+	float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	void Combine(const float* p) {
+		for (int i = 0; i < 3; ++i) {
+			min[i] = std::min(min[i], p[i]);
+			max[i] = std::max(max[i], p[i]);
+		}
+	}
+	void Combine(const float* bmin, const float* bmax) {
+		for (int i = 0; i < 3; ++i) {
+			min[i] = std::min(min[i], bmin[i]);
+			max[i] = std::max(max[i], bmax[i]);
+		}
+	}
+	float Area() const {
+		const float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+		return dx < 0 ? 0 : 2 * (dx * dy + dy * dz + dz * dx);
+	}
+};
+
+}
+
+namespace quake
+{
+
+void MapSpatialIndex::Build(const std::vector<std::shared_ptr<MapEntity>>& entities)
+{
+	Clear();
+
+	for (size_t i = 0, n = entities.size(); i < n; ++i)
+	{
+		auto& brushes = entities[i]->brushes;
+		for (size_t j = 0, m = brushes.size(); j < m; ++j) {
+			if (brushes[j] && !brushes[j]->Points().empty()) {
+				m_brushes.push_back({ static_cast<uint32_t>(i), static_cast<uint32_t>(j) });
+			}
+		}
+	}
+
+	const size_t num = m_brushes.size();
+	if (num == 0) {
+		return;
+	}
+
+	// plane ranges padded to 4 so the brush test always works on full vectors
+	m_plane_ranges.resize(num);
+	uint32_t plane_num = 0;
+	for (size_t i = 0; i < num; ++i)
+	{
+		auto& b = entities[m_brushes[i].entity]->brushes[m_brushes[i].brush];
+		const uint32_t count = static_cast<uint32_t>(b->Faces().size());
+		m_plane_ranges[i] = { plane_num, count };
+		plane_num += (count + 3) & ~3u;
+	}
+	m_planes.nx.assign(plane_num, 0.0f);
+	m_planes.ny.assign(plane_num, 0.0f);
+	m_planes.nz.assign(plane_num, 0.0f);
+	m_planes.d.assign(plane_num, 1.0f);
+
+	m_bounds.resize(num * 6);
+	m_centroids.resize(num * 3);
+
+	ParallelFor(num, 256, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			auto& b = entities[m_brushes[i].entity]->brushes[m_brushes[i].brush];
+
+			Bounds bounds;
+			sm::vec3 center;
+			auto& points = b->Points();
+			for (auto& p : points) {
+				bounds.Combine(&p->pos.x);
+				center += p->pos;
+			}
+			center *= 1.0f / points.size();
+
+			std::copy(bounds.min, bounds.min + 3, &m_bounds[i * 6]);
+			std::copy(bounds.max, bounds.max + 3, &m_bounds[i * 6 + 3]);
+			for (int k = 0; k < 3; ++k) {
+				m_centroids[i * 3 + k] = (bounds.min[k] + bounds.max[k]) * 0.5f;
+			}
+
+			uint32_t dst = m_plane_ranges[i].first;
+			for (auto& f : b->Faces())
+			{
+				sm::vec3 normal = f->plane.normal;
+				if (f->plane.GetDistance(center) > 0) {
+					normal = -normal;
+				}
+				float d = -FLT_MAX;
+				for (auto& p : points) {
+					d = std::max(d, normal.Dot(p->pos));
+				}
+				m_planes.nx[dst] = normal.x;
+				m_planes.ny[dst] = normal.y;
+				m_planes.nz[dst] = normal.z;
+				m_planes.d[dst]  = d;
+				++dst;
+			}
+		}
+	});
+
+	m_refs.resize(num);
+	for (size_t i = 0; i < num; ++i) {
+		m_refs[i] = static_cast<uint32_t>(i);
+	}
+
+	m_nodes.reserve(num * 2 / MAX_LEAF_SIZE + 1);
+	BuildRecursive(0, static_cast<uint32_t>(num), m_nodes, 0);
+}
+
+void MapSpatialIndex::Clear()
+{
+	m_brushes.clear();
+	m_bounds.clear();
+	m_centroids.clear();
+	m_planes.nx.clear();
+	m_planes.ny.clear();
+	m_planes.nz.clear();
+	m_planes.d.clear();
+	m_plane_ranges.clear();
+	m_refs.clear();
+	m_nodes.clear();
+}
+
+bool MapSpatialIndex::Raycast(const Ray& ray, Hit& hit) const
+{
+	hit = Hit();
+	if (m_nodes.empty()) {
+		return false;
+	}
+
+	float inv[3];
+	for (int i = 0; i < 3; ++i) {
+		inv[i] = ray.dir[i] != 0 ? 1.0f / ray.dir[i] : FLT_MAX;
+	}
+
+#ifdef QUAKE_SIMD_SSE2
+	const __m128 o4   = _mm_set_ps(0, ray.origin.z, ray.origin.y, ray.origin.x);
+	const __m128 inv4 = _mm_set_ps(0, inv[2], inv[1], inv[0]);
+#endif // QUAKE_SIMD_SSE2
+
+	auto hit_node = [&](const Node& node, float t_max, float& t_near) -> bool
+	{
+#ifdef QUAKE_SIMD_SSE2
+		const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min), o4), inv4);
+		const __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max), o4), inv4);
+		// lane 3 holds offset/count, replace it by z
+		__m128 lo = _mm_min_ps(t1, t2);
+		__m128 hi = _mm_max_ps(t1, t2);
+		lo = _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(2, 2, 1, 0));
+		hi = _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(2, 2, 1, 0));
+		lo = _mm_max_ps(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(1, 0, 3, 2)));
+		lo = _mm_max_ps(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(2, 3, 0, 1)));
+		hi = _mm_min_ps(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(1, 0, 3, 2)));
+		hi = _mm_min_ps(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(2, 3, 0, 1)));
+		const float t0 = std::max(_mm_cvtss_f32(lo), 0.0f);
+		const float t1s = std::min(_mm_cvtss_f32(hi), t_max);
+#else
+		float t0 = 0, t1s = t_max;
+		for (int i = 0; i < 3; ++i)
+		{
+			float a = (node.min[i] - ray.origin[i]) * inv[i];
+			float b = (node.max[i] - ray.origin[i]) * inv[i];
+			if (a > b) {
+				std::swap(a, b);
+			}
+			t0  = std::max(t0, a);
+			t1s = std::min(t1s, b);
+		}
+#endif // QUAKE_SIMD_SSE2
+		t_near = t0;
+		return t0 <= t1s;
+	};
+
+	float best = ray.max_dist;
+
+	uint32_t stack[STACK_SIZE];
+	int sp = 0;
+
+	float t_near;
+	if (!hit_node(m_nodes[0], best, t_near)) {
+		return false;
+	}
+	stack[sp++] = 0;
+
+	while (sp > 0)
+	{
+		const Node& node = m_nodes[stack[--sp]];
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = 0; i < node.count; ++i)
+			{
+				const uint32_t brush = m_refs[node.offset + i];
+				float dist;
+				sm::vec3 normal;
+				if (IntersectBrush(brush, ray, best, dist, normal)) {
+					best = dist;
+					hit.brush  = static_cast<int>(brush);
+					hit.dist   = dist;
+					hit.normal = normal;
+				}
+			}
+			continue;
+		}
+
+		const uint32_t c0 = static_cast<uint32_t>(&node - m_nodes.data()) + 1;
+		const uint32_t c1 = node.offset;
+		float t0, t1;
+		const bool h0 = hit_node(m_nodes[c0], best, t0);
+		const bool h1 = hit_node(m_nodes[c1], best, t1);
+		assert(sp + 2 <= STACK_SIZE);
+		if (h0 && h1) {
+			// visit the closer one first
+			if (t0 < t1) {
+				stack[sp++] = c1;
+				stack[sp++] = c0;
+			} else {
+				stack[sp++] = c0;
+				stack[sp++] = c1;
+			}
+		} else if (h0) {
+			stack[sp++] = c0;
+		} else if (h1) {
+			stack[sp++] = c1;
+		}
+	}
+
+	return hit.brush >= 0;
+}
+
+void MapSpatialIndex::RaycastBatch(const Ray* rays, size_t count, Hit* hits) const
+{
+	ParallelFor(count, 64, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			Raycast(rays[i], hits[i]);
+		}
+	});
+}
+
+void MapSpatialIndex::QueryBox(const sm::vec3& min, const sm::vec3& max, std::vector<uint32_t>& brushes) const
+{
+	if (m_nodes.empty()) {
+		return;
+	}
+
+	auto overlap = [&](const float* bmin, const float* bmax) {
+		return bmin[0] <= max.x && bmax[0] >= min.x
+			&& bmin[1] <= max.y && bmax[1] >= min.y
+			&& bmin[2] <= max.z && bmax[2] >= min.z;
+	};
+
+	uint32_t stack[STACK_SIZE];
+	int sp = 0;
+	stack[sp++] = 0;
+	while (sp > 0)
+	{
+		const uint32_t idx = stack[--sp];
+		const Node& node = m_nodes[idx];
+		if (!overlap(node.min, node.max)) {
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = 0; i < node.count; ++i)
+			{
+				const uint32_t brush = m_refs[node.offset + i];
+				if (overlap(&m_bounds[brush * 6], &m_bounds[brush * 6 + 3])) {
+					brushes.push_back(brush);
+				}
+			}
+		}
+		else
+		{
+			assert(sp + 2 <= STACK_SIZE);
+			stack[sp++] = node.offset;
+			stack[sp++] = idx + 1;
+		}
+	}
+}
+
+uint32_t MapSpatialIndex::BuildRecursive(uint32_t first, uint32_t count, std::vector<Node>& nodes, int depth)
+{
+	Bounds bounds, centroid_bounds;
+	for (uint32_t i = first; i < first + count; ++i)
+	{
+		const uint32_t b = m_refs[i];
+		bounds.Combine(&m_bounds[b * 6], &m_bounds[b * 6 + 3]);
+		centroid_bounds.Combine(&m_centroids[b * 3]);
+	}
+
+	const uint32_t idx = static_cast<uint32_t>(nodes.size());
+	nodes.push_back(Node());
+	std::copy(bounds.min, bounds.min + 3, nodes[idx].min);
+	std::copy(bounds.max, bounds.max + 3, nodes[idx].max);
+
+	auto make_leaf = [&]() {
+		nodes[idx].offset = first;
+		nodes[idx].count  = count;
+		return idx;
+	};
+
+	if (count <= MAX_LEAF_SIZE || depth >= MAX_DEPTH) {
+		return make_leaf();
+	}
+
+	// binned sah
+	int   best_axis = -1;
+	int   best_bin  = 0;
+	float best_cost = FLT_MAX;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float cmin = centroid_bounds.min[axis];
+		const float cmax = centroid_bounds.max[axis];
+		if (cmax - cmin < 1e-6f) {
+			continue;
+		}
+
+		Bounds   bin_bounds[SAH_BINS];
+		uint32_t bin_count[SAH_BINS] = { 0 };
+		const float scale = SAH_BINS / (cmax - cmin);
+		for (uint32_t i = first; i < first + count; ++i)
+		{
+			const uint32_t b = m_refs[i];
+			int bin = static_cast<int>((m_centroids[b * 3 + axis] - cmin) * scale);
+			bin = std::min(bin, SAH_BINS - 1);
+			bin_bounds[bin].Combine(&m_bounds[b * 6], &m_bounds[b * 6 + 3]);
+			++bin_count[bin];
+		}
+
+		float    right_area[SAH_BINS];
+		uint32_t right_count[SAH_BINS];
+		Bounds acc;
+		uint32_t n = 0;
+		for (int i = SAH_BINS - 1; i > 0; --i)
+		{
+			acc.Combine(bin_bounds[i].min, bin_bounds[i].max);
+			n += bin_count[i];
+			right_area[i]  = acc.Area();
+			right_count[i] = n;
+		}
+
+		acc = Bounds();
+		n = 0;
+		for (int i = 0; i < SAH_BINS - 1; ++i)
+		{
+			acc.Combine(bin_bounds[i].min, bin_bounds[i].max);
+			n += bin_count[i];
+			const float cost = acc.Area() * n + right_area[i + 1] * right_count[i + 1];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_bin  = i;
+			}
+		}
+	}
+
+	uint32_t mid = first + count / 2;
+	if (best_axis >= 0)
+	{
+		const float leaf_cost = bounds.Area() * count;
+		if (best_cost >= leaf_cost && count <= MAX_LEAF_SIZE * 4) {
+			return make_leaf();
+		}
+
+		const float cmin  = centroid_bounds.min[best_axis];
+		const float scale = SAH_BINS / (centroid_bounds.max[best_axis] - cmin);
+		auto itr = std::partition(m_refs.begin() + first, m_refs.begin() + first + count, [&](uint32_t b) {
+			int bin = static_cast<int>((m_centroids[b * 3 + best_axis] - cmin) * scale);
+			return std::min(bin, SAH_BINS - 1) <= best_bin;
+		});
+		mid = static_cast<uint32_t>(itr - m_refs.begin());
+		if (mid == first || mid == first + count) {
+			mid = first + count / 2;
+		}
+	}
+
+	uint32_t right;
+	if (depth < PARALLEL_BUILD_DEPTH && count > PARALLEL_BUILD_MIN)
+	{
+		std::vector<Node> right_nodes;
+		auto future = std::async(std::launch::async, [&]() {
+			BuildRecursive(mid, first + count - mid, right_nodes, depth + 1);
+		});
+		BuildRecursive(first, mid - first, nodes, depth + 1);
+		future.get();
+
+		right = static_cast<uint32_t>(nodes.size());
+		for (auto& n : right_nodes) {
+			if (!n.IsLeaf()) {
+				n.offset += right;
+			}
+			nodes.push_back(n);
+		}
+	}
+	else
+	{
+		BuildRecursive(first, mid - first, nodes, depth + 1);
+		right = BuildRecursive(mid, first + count - mid, nodes, depth + 1);
+	}
+
+	nodes[idx].offset = right;
+	nodes[idx].count  = 0;
+
+	return idx;
+}
+
+bool MapSpatialIndex::IntersectBrush(uint32_t brush, const Ray& ray, float max_dist,
+	                                 float& dist, sm::vec3& normal) const
+{
+	auto& range = m_plane_ranges[brush];
+	const uint32_t end = range.first + ((range.count + 3) & ~3u);
+
+	float t_enter = -FLT_MAX;
+	float t_exit  =  FLT_MAX;
+
+#ifdef QUAKE_SIMD_SSE2
+	const __m128 ox = _mm_set1_ps(ray.origin.x), oy = _mm_set1_ps(ray.origin.y), oz = _mm_set1_ps(ray.origin.z);
+	const __m128 dx = _mm_set1_ps(ray.dir.x), dy = _mm_set1_ps(ray.dir.y), dz = _mm_set1_ps(ray.dir.z);
+	const __m128 zero = _mm_setzero_ps();
+	__m128 enter4 = _mm_set1_ps(-FLT_MAX);
+	__m128 exit4  = _mm_set1_ps(FLT_MAX);
+	for (uint32_t i = range.first; i < end; i += 4)
+	{
+		const __m128 nx = _mm_loadu_ps(&m_planes.nx[i]);
+		const __m128 ny = _mm_loadu_ps(&m_planes.ny[i]);
+		const __m128 nz = _mm_loadu_ps(&m_planes.nz[i]);
+		const __m128 d  = _mm_loadu_ps(&m_planes.d[i]);
+
+		const __m128 denom = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, dx), _mm_mul_ps(ny, dy)), _mm_mul_ps(nz, dz));
+		const __m128 num = _mm_sub_ps(d, _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, ox), _mm_mul_ps(ny, oy)), _mm_mul_ps(nz, oz)));
+
+		// parallel to a plane and outside of it
+		const __m128 parallel = _mm_cmpeq_ps(denom, zero);
+		if (_mm_movemask_ps(_mm_and_ps(parallel, _mm_cmplt_ps(num, zero))) != 0) {
+			return false;
+		}
+
+		const __m128 t = _mm_div_ps(num, _mm_or_ps(denom, _mm_and_ps(parallel, _mm_set1_ps(1.0f))));
+		const __m128 entering = _mm_cmplt_ps(denom, zero);
+		const __m128 leaving  = _mm_cmpgt_ps(denom, zero);
+		enter4 = _mm_max_ps(enter4, _mm_or_ps(_mm_and_ps(entering, t), _mm_andnot_ps(entering, _mm_set1_ps(-FLT_MAX))));
+		exit4  = _mm_min_ps(exit4,  _mm_or_ps(_mm_and_ps(leaving,  t), _mm_andnot_ps(leaving,  _mm_set1_ps(FLT_MAX))));
+	}
+	enter4 = _mm_max_ps(enter4, _mm_shuffle_ps(enter4, enter4, _MM_SHUFFLE(1, 0, 3, 2)));
+	enter4 = _mm_max_ps(enter4, _mm_shuffle_ps(enter4, enter4, _MM_SHUFFLE(2, 3, 0, 1)));
+	exit4  = _mm_min_ps(exit4,  _mm_shuffle_ps(exit4,  exit4,  _MM_SHUFFLE(1, 0, 3, 2)));
+	exit4  = _mm_min_ps(exit4,  _mm_shuffle_ps(exit4,  exit4,  _MM_SHUFFLE(2, 3, 0, 1)));
+	t_enter = _mm_cvtss_f32(enter4);
+	t_exit  = _mm_cvtss_f32(exit4);
+#else
+	for (uint32_t i = range.first; i < end; ++i)
+	{
+		const float denom = m_planes.nx[i] * ray.dir.x + m_planes.ny[i] * ray.dir.y + m_planes.nz[i] * ray.dir.z;
+		const float num = m_planes.d[i] - (m_planes.nx[i] * ray.origin.x + m_planes.ny[i] * ray.origin.y + m_planes.nz[i] * ray.origin.z);
+		if (denom == 0) {
+			if (num < 0) {
+				return false;
+			}
+		} else if (denom < 0) {
+			t_enter = std::max(t_enter, num / denom);
+		} else {
+			t_exit = std::min(t_exit, num / denom);
+		}
+	}
+#endif // QUAKE_SIMD_SSE2
+
+	if (t_enter > t_exit || t_exit < 0) {
+		return false;
+	}
+
+	dist = std::max(t_enter, 0.0f);
+	if (dist > max_dist) {
+		return false;
+	}
+
+	// starting inside the brush has no entry plane
+	normal = sm::vec3(0, 0, 0);
+	if (t_enter >= 0)
+	{
+		float best = -FLT_MAX;
+		for (uint32_t i = range.first; i < range.first + range.count; ++i)
+		{
+			const float denom = m_planes.nx[i] * ray.dir.x + m_planes.ny[i] * ray.dir.y + m_planes.nz[i] * ray.dir.z;
+			if (denom >= 0) {
+				continue;
+			}
+			const float num = m_planes.d[i] - (m_planes.nx[i] * ray.origin.x + m_planes.ny[i] * ray.origin.y + m_planes.nz[i] * ray.origin.z);
+			if (num / denom > best) {
+				best = num / denom;
+				normal = sm::vec3(m_planes.nx[i], m_planes.ny[i], m_planes.nz[i]);
+			}
+		}
+	}
+
+	return true;
+}
+
+}
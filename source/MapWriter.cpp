@@ -0,0 +1,420 @@
+#include "quake/MapWriter.h"
+#include "quake/BrushFaces.h"
+#include "quake/ParallelFor.h"
+#include "quake/Profiler.h"
+
+#include <polymesh3/Polytope.h>
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <locale>
+#include <mutex>
+#include <algorithm>
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+
+namespace
+{
+
+const std::string NoTextureName = "__TB_empty";
+
+// plane points closer than this to an integer are written as the integer
+const float SNAP_EPSILON = 0.001f;
+
+const size_t WRITE_BUF_SIZE = 1 << 20;
+
+// six faces of about 70 chars
+const size_t BRUSH_TEXT_SIZE_HINT = 448;
+
+// the parser swaps y and z when reading points
+sm::vec3 ToFileSpace(const sm::vec3& v)
+{
+	return sm::vec3(v.x, v.z, v.y);
+}
+
+sm::vec3 Snap(const sm::vec3& v)
+{
+	sm::vec3 ret;
+	for (int i = 0; i < 3; ++i)
+	{
+		const float r = roundf(v[i]);
+		ret[i] = fabsf(v[i] - r) < SNAP_EPSILON ? r : v[i];
+	}
+	return ret;
+}
+
+const float ON_PLANE_EPSILON = 0.01f;
+
+// three points in parser space which give back the face's plane, taken
+// from the brush's points on it so integer maps stay integer
+void CalcPlanePoints(const pm3::Polytope& brush, const pm3::Polytope::Face& face, sm::vec3 points[3])
+{
+	// widest triangle: any point, the farthest from it, then the farthest
+	// from the line through both
+	const sm::vec3* a = nullptr;
+	for (auto& p : brush.Points()) {
+		if (fabsf(face.plane.GetDistance(p->pos)) < ON_PLANE_EPSILON) {
+			a = &p->pos;
+			break;
+		}
+	}
+
+	const sm::vec3* b = nullptr;
+	const sm::vec3* c = nullptr;
+	if (a)
+	{
+		float best = 0;
+		for (auto& p : brush.Points()) {
+			if (fabsf(face.plane.GetDistance(p->pos)) < ON_PLANE_EPSILON) {
+				const float d = (p->pos - *a).LengthSquared();
+				if (d > best) {
+					best = d;
+					b = &p->pos;
+				}
+			}
+		}
+	}
+	if (b)
+	{
+		const sm::vec3 ab = *b - *a;
+		float best = 0;
+		for (auto& p : brush.Points()) {
+			if (fabsf(face.plane.GetDistance(p->pos)) < ON_PLANE_EPSILON) {
+				const float d = ab.Cross(p->pos - *a).LengthSquared();
+				if (d > best) {
+					best = d;
+					c = &p->pos;
+				}
+			}
+		}
+	}
+
+	if (c)
+	{
+		points[0] = Snap(*a);
+		points[1] = Snap(*b);
+		points[2] = Snap(*c);
+	}
+	else
+	{
+		// no polygon, any three points on the plane
+		auto& n = face.plane.normal;
+		const sm::vec3 p = n * -face.plane.dist;
+		sm::vec3 axis(1, 0, 0);
+		if (fabsf(n.y) < fabsf(n.x) && fabsf(n.y) <= fabsf(n.z)) {
+			axis = sm::vec3(0, 1, 0);
+		} else if (fabsf(n.z) < fabsf(n.x)) {
+			axis = sm::vec3(0, 0, 1);
+		}
+		const sm::vec3 u = n.Cross(axis).Normalized();
+		const sm::vec3 v = n.Cross(u);
+		points[0] = p;
+		points[1] = p + u * 128.0f;
+		points[2] = p + v * 128.0f;
+	}
+
+	if (sm::Plane(points[0], points[1], points[2]).normal.Dot(face.plane.normal) < 0) {
+		std::swap(points[1], points[2]);
+	}
+}
+
+void Append(std::string& out, float f)
+{
+	char buf[32];
+	out.append(buf, quake::MapWriter::FormatFloat(f, buf));
+}
+
+void AppendPoint(std::string& out, const sm::vec3& p)
+{
+	const sm::vec3 v = ToFileSpace(p);
+	out += "( ";
+	Append(out, v.x);
+	out += ' ';
+	Append(out, v.y);
+	out += ' ';
+	Append(out, v.z);
+	out += " ) ";
+}
+
+const int MAX_SHORT_DECIMALS = 4;
+const double POW10[MAX_SHORT_DECIMALS + 1] = { 1, 10, 100, 1000, 10000 };
+
+// m / 10^k with k digits after the point
+size_t FormatFixed(uint64_t m, int k, bool neg, char* buf)
+{
+	char tmp[24];
+	int n = 0;
+	do {
+		tmp[n++] = static_cast<char>('0' + m % 10);
+		m /= 10;
+	} while (m > 0 || n <= k);
+
+	size_t len = 0;
+	if (neg) {
+		buf[len++] = '-';
+	}
+	while (n > k) {
+		buf[len++] = tmp[--n];
+	}
+	if (k > 0) {
+		buf[len++] = '.';
+		while (n > 0) {
+			buf[len++] = tmp[--n];
+		}
+	}
+	buf[len] = 0;
+	return len;
+}
+
+struct Chunk
+{
+	size_t begin;   // first brush
+	std::string text;
+	std::vector<size_t> ends;   // end of each brush in text
+};
+
+struct StreamOut
+{
+	std::ostream& os;
+
+	void append(const char* s, size_t n) { os.write(s, n); }
+	void append(const std::string& s) { os.write(s.data(), s.size()); }
+};
+
+}
+
+namespace quake
+{
+
+MapWriter::MapWriter(MapFormat::Type format)
+	: m_format(format == MapFormat::Valve ? MapFormat::Valve : MapFormat::Standard)
+{
+}
+
+void MapWriter::Write(std::ostream& os, const std::vector<std::shared_ptr<MapEntity>>& entities) const
+{
+	StreamOut out{ os };
+	Emit(out, entities);
+}
+
+bool MapWriter::WriteToFile(const std::string& filepath, const std::vector<std::shared_ptr<MapEntity>>& entities) const
+{
+	std::vector<char> buf(WRITE_BUF_SIZE);
+	std::ofstream fout;
+	fout.rdbuf()->pubsetbuf(buf.data(), buf.size());
+	fout.open(filepath, std::ios::binary);
+	if (fout.fail()) {
+		return false;
+	}
+
+	Write(fout, entities);
+	fout.close();
+	return !fout.fail();
+}
+
+std::string MapWriter::ToString(const std::vector<std::shared_ptr<MapEntity>>& entities) const
+{
+	std::string str;
+	Emit(str, entities);
+	return str;
+}
+
+size_t MapWriter::FormatFloat(float f, char* buf)
+{
+	if (f == 0) {
+		buf[0] = '0';
+		buf[1] = 0;
+		return 1;
+	}
+
+	// integers and short decimals, nearly all of a map's numbers. the text is
+	// the first m / 10^k whose distance to f is clearly below half an ulp,
+	// so it reads back to f. too close to call goes to the slow path
+	const float abs_f = fabsf(f);
+	if (abs_f < 1e8f)
+	{
+		const double half_ulp = std::min(nextafterf(abs_f, FLT_MAX) - abs_f,
+			abs_f - nextafterf(abs_f, 0.0f)) * 0.5;
+		for (int k = 0; k <= MAX_SHORT_DECIMALS; ++k)
+		{
+			const double m = nearbyint(static_cast<double>(abs_f) * POW10[k]);
+			const double diff = fabs(m / POW10[k] - abs_f);
+			if (diff < half_ulp * (1 - 1e-6)) {
+				return FormatFixed(static_cast<uint64_t>(m), k, f < 0, buf);
+			}
+		}
+	}
+
+	// shortest %g style text which reads back exactly, 9 digits always do
+	// for floats. streams in the classic locale, snprintf and strtof would
+	// go by the global one and may use a decimal comma
+	std::ostringstream os;
+	os.imbue(std::locale::classic());
+	std::istringstream is;
+	is.imbue(std::locale::classic());
+	std::string str;
+	for (int precision = 6; precision <= 9; ++precision)
+	{
+		os.str("");
+		os << std::setprecision(precision) << f;
+		str = os.str();
+
+		is.clear();
+		is.str(str);
+		float v = 0;
+		if ((is >> v) && v == f) {
+			break;
+		}
+	}
+	memcpy(buf, str.c_str(), str.size() + 1);
+	return str.size();
+}
+
+template <typename Out>
+void MapWriter::Emit(Out& out, const std::vector<std::shared_ptr<MapEntity>>& entities) const
+{
+	QUAKE_PROFILE_SCOPE("MapWriter::Write");
+
+	std::vector<const pm3::Polytope*> brushes;
+	std::vector<const sm::vec3*> tex_axes;
+	std::vector<size_t> first_brush(entities.size() + 1, 0);
+	for (size_t i = 0, n = entities.size(); i < n; ++i)
+	{
+		first_brush[i] = brushes.size();
+		if (!entities[i]) {
+			continue;
+		}
+		auto& e = *entities[i];
+		for (size_t j = 0, m = e.brushes.size(); j < m; ++j)
+		{
+			if (e.brushes[j]) {
+				brushes.push_back(e.brushes[j].get());
+				tex_axes.push_back(e.GetTexAxes(j));
+			}
+		}
+	}
+	first_brush[entities.size()] = brushes.size();
+
+	std::vector<Chunk> chunks;
+	std::mutex chunks_mtx;
+	ParallelFor(brushes.size(), 256, [&](size_t begin, size_t end)
+	{
+		Chunk chunk;
+		chunk.begin = begin;
+		chunk.ends.reserve(end - begin);
+		chunk.text.reserve((end - begin) * BRUSH_TEXT_SIZE_HINT);
+		for (size_t i = begin; i < end; ++i) {
+			FormatBrush(*brushes[i], tex_axes[i], chunk.text);
+			chunk.ends.push_back(chunk.text.size());
+		}
+
+		std::lock_guard<std::mutex> lock(chunks_mtx);
+		chunks.push_back(std::move(chunk));
+	});
+	std::sort(chunks.begin(), chunks.end(), [](const Chunk& a, const Chunk& b) {
+		return a.begin < b.begin;
+	});
+
+	// entity headers inline, brushes as runs of the chunks
+	size_t chunk_idx = 0;
+	std::string header;
+	for (size_t i = 0, n = entities.size(); i < n; ++i)
+	{
+		if (!entities[i]) {
+			continue;
+		}
+
+		header = "{\n";
+		for (auto& attr : entities[i]->attributes) {
+			header += '"';
+			header += attr.name;
+			header += "\" \"";
+			header += attr.val;
+			header += "\"\n";
+		}
+		out.append(header.data(), header.size());
+
+		size_t brush = first_brush[i];
+		while (brush < first_brush[i + 1])
+		{
+			while (chunks[chunk_idx].begin + chunks[chunk_idx].ends.size() <= brush) {
+				++chunk_idx;
+			}
+			auto& chunk = chunks[chunk_idx];
+			const size_t local_begin = brush - chunk.begin;
+			const size_t local_end = std::min(first_brush[i + 1] - chunk.begin, chunk.ends.size());
+			const size_t text_begin = local_begin == 0 ? 0 : chunk.ends[local_begin - 1];
+			out.append(chunk.text.data() + text_begin, chunk.ends[local_end - 1] - text_begin);
+			brush = chunk.begin + local_end;
+		}
+
+		out.append("}\n", 2);
+	}
+}
+
+void MapWriter::FormatBrush(const pm3::Polytope& brush, const sm::vec3* tex_axes, std::string& out) const
+{
+	out += "{\n";
+	auto& faces = brush.Faces();
+	for (size_t i = 0, n = faces.size(); i < n; ++i)
+	{
+		auto& f = faces[i];
+
+		sm::vec3 points[3];
+		CalcPlanePoints(brush, *f, points);
+		for (auto& p : points) {
+			AppendPoint(out, p);
+		}
+
+		auto& tex_map = f->tex_map;
+		out += tex_map.tex_name.empty() ? NoTextureName : tex_map.tex_name;
+		out += ' ';
+		if (m_format == MapFormat::Valve)
+		{
+			sm::vec3 s_axis, t_axis;
+			if (tex_axes)
+			{
+				s_axis = tex_axes[i * 2];
+				t_axis = tex_axes[i * 2 + 1];
+			}
+			else
+			{
+				// the projection axis is picked the same for either side
+				CalcTextureAxis(f->plane.normal, tex_map.angle, sm::vec2(1, 1), s_axis, t_axis);
+			}
+			s_axis = ToFileSpace(s_axis);
+			t_axis = ToFileSpace(t_axis);
+
+			out += "[ ";
+			Append(out, s_axis.x); out += ' ';
+			Append(out, s_axis.y); out += ' ';
+			Append(out, s_axis.z); out += ' ';
+			Append(out, tex_map.offset.x);
+			out += " ] [ ";
+			Append(out, t_axis.x); out += ' ';
+			Append(out, t_axis.y); out += ' ';
+			Append(out, t_axis.z); out += ' ';
+			Append(out, tex_map.offset.y);
+			out += " ] ";
+		}
+		else
+		{
+			Append(out, tex_map.offset.x);
+			out += ' ';
+			Append(out, tex_map.offset.y);
+			out += ' ';
+		}
+		Append(out, tex_map.angle);
+		out += ' ';
+		Append(out, tex_map.scale.x);
+		out += ' ';
+		Append(out, tex_map.scale.y);
+		out += '\n';
+	}
+	out += "}\n";
+}
+
+}
@@ -0,0 +1,226 @@
+#include "quake/MemoryReport.h"
+#include "quake/MapParser.h"
+#include "quake/MapContext.h"
+#include "quake/MapLoader.h"
+#include "quake/MapFaceTable.h"
+#include "quake/MapEntityTable.h"
+#include "quake/TextureManager.h"
+#include "quake/Lightmaps.h"
+
+#include <polymesh3/Polytope.h>
+
+#include <stdio.h>
+
+namespace
+{
+
+void AppendLine(std::string& out, const char* label, size_t bytes)
+{
+	char buf[128];
+	snprintf(buf, sizeof(buf), "  %-20s %12zu  %9.2f MB\n", label, bytes, bytes / (1024.0 * 1024.0));
+	out += buf;
+}
+
+void AppendUsage(std::string& out, const std::string& name, const quake::MemoryReport::Usage& usage)
+{
+	out += name;
+	out += '\n';
+	for (int i = 0; i < quake::MemoryCategory::MaxCount; ++i) {
+		auto type = static_cast<quake::MemoryCategory::Type>(i);
+		AppendLine(out, quake::MemoryCategory::Name(type), usage.bytes[i]);
+	}
+	AppendLine(out, "total", usage.Total());
+}
+
+}
+
+namespace quake
+{
+
+const char* MemoryCategory::Name(Type type)
+{
+	switch (type)
+	{
+	case EntityAttributes:
+		return "entity_attributes";
+	case Entities:
+		return "entities";
+	case Polytopes:
+		return "polytopes";
+	case FaceTexNames:
+		return "face_tex_names";
+	case FaceTable:
+		return "face_table";
+	case EntityTable:
+		return "entity_table";
+	case ParserOther:
+		return "parser_other";
+	case MapSource:
+		return "map_source";
+	case TextureHost:
+		return "texture_host";
+	case TextureGpu:
+		return "texture_gpu";
+	case LightmapsUsed:
+		return "lightmaps_used";
+	case LightmapsReserved:
+		return "lightmaps_reserved";
+	default:
+		return "unknown";
+	}
+}
+
+size_t MemoryBytes::String(const std::string& str)
+{
+	// short strings live in the object itself
+	static const size_t sso_capacity = std::string().capacity();
+	return str.capacity() > sso_capacity ? str.capacity() + 1 : 0;
+}
+
+MemoryReport::Usage::Usage()
+{
+	for (auto& b : bytes) {
+		b = 0;
+	}
+}
+
+size_t MemoryReport::Usage::Total() const
+{
+	// the reserved lightmap atlas already holds the used pages
+	size_t total = 0;
+	for (int i = 0; i < MemoryCategory::MaxCount; ++i) {
+		if (i != MemoryCategory::LightmapsUsed) {
+			total += bytes[i];
+		}
+	}
+	return total;
+}
+
+MemoryReport::Usage& MemoryReport::Usage::operator += (const Usage& usage)
+{
+	for (int i = 0; i < MemoryCategory::MaxCount; ++i) {
+		bytes[i] += usage.bytes[i];
+	}
+	return *this;
+}
+
+void MemoryReport::AddMap(const std::string& name, const MapParser* parser,
+	                      const MapContext* ctx, const MapLoader* loader)
+{
+	Map map;
+	map.name = name;
+	if (parser) {
+		map.usage += Measure(*parser);
+	}
+	if (ctx) {
+		map.usage += Measure(*ctx);
+	}
+	if (loader) {
+		map.usage += Measure(*loader);
+	}
+	m_maps.push_back(map);
+}
+
+MemoryReport::Usage MemoryReport::GetTotal() const
+{
+	Usage total;
+	for (auto& map : m_maps) {
+		total += map.usage;
+	}
+	return total;
+}
+
+std::string MemoryReport::ToString() const
+{
+	std::string out;
+	for (auto& map : m_maps) {
+		AppendUsage(out, map.name, map.usage);
+	}
+	if (m_maps.size() > 1) {
+		AppendUsage(out, "all maps", GetTotal());
+	}
+	return out;
+}
+
+MemoryReport::Usage MemoryReport::Measure(const MapParser& parser)
+{
+	Usage usage;
+	auto& bytes = usage.bytes;
+
+	auto& entities = parser.GetAllEntities();
+	bytes[MemoryCategory::Entities] += MemoryBytes::Vector(entities);
+	for (auto& e : entities)
+	{
+		bytes[MemoryCategory::Entities] += MemoryBytes::Shared(e) + MemoryBytes::Vector(e->brushes)
+			+ MemoryBytes::Vector(e->surfaces) + MemoryBytes::Vector(e->surface_offsets) + MemoryBytes::Vector(e->tex_axes);
+
+		bytes[MemoryCategory::EntityAttributes] += MemoryBytes::Vector(e->attributes);
+		for (auto& attr : e->attributes) {
+			bytes[MemoryCategory::EntityAttributes] += MemoryBytes::String(attr.name) + MemoryBytes::String(attr.val);
+		}
+
+		for (auto& b : e->brushes)
+		{
+			if (!b) {
+				continue;
+			}
+
+			size_t poly = MemoryBytes::Shared(b) + MemoryBytes::Vector(b->Points()) + MemoryBytes::Vector(b->Faces());
+			for (auto& p : b->Points()) {
+				poly += MemoryBytes::Shared(p);
+			}
+			for (auto& f : b->Faces()) {
+				poly += MemoryBytes::Shared(f) + MemoryBytes::Vector(f->points);
+				bytes[MemoryCategory::FaceTexNames] += MemoryBytes::String(f->tex_map.tex_name);
+			}
+			bytes[MemoryCategory::Polytopes] += poly;
+		}
+	}
+
+	if (auto& table = parser.GetFaceTable()) {
+		bytes[MemoryCategory::FaceTable] += MemoryBytes::Shared(table) + table->GetMemoryBytes();
+	}
+	if (auto& table = parser.GetEntityTable()) {
+		bytes[MemoryCategory::EntityTable] += MemoryBytes::Shared(table) + table->GetMemoryBytes();
+	}
+
+	auto& usage_map = parser.GetTextureUsage();
+	bytes[MemoryCategory::ParserOther] += MemoryBytes::Hash(usage_map);
+	for (auto& itr : usage_map) {
+		bytes[MemoryCategory::ParserOther] += MemoryBytes::String(itr.first);
+	}
+
+	return usage;
+}
+
+MemoryReport::Usage MemoryReport::Measure(const MapContext& ctx)
+{
+	Usage usage;
+	auto& bytes = usage.bytes;
+
+	auto& textures = ctx.GetTextures();
+	bytes[MemoryCategory::TextureHost] += textures.GetHostBytes();
+	bytes[MemoryCategory::TextureGpu]  += textures.GetDeviceBytes();
+
+	auto& lightmaps = ctx.GetLightmaps();
+	const size_t used = lightmaps.GetUsedPages() * lightmaps.GetPageBytes();
+	bytes[MemoryCategory::LightmapsUsed]     += used;
+	bytes[MemoryCategory::LightmapsReserved] += sizeof(Lightmaps) + lightmaps.GetReservedBytes();
+	// CreatetTextures uploads every used page, RGB9E5 as half floats
+	if (lightmaps.GetUploadedPages() > 0) {
+		bytes[MemoryCategory::TextureGpu] += lightmaps.GetFormat() == Lightmaps::Format::RGB9E5
+			? lightmaps.GetUsedPages() * Lightmaps::BLOCK_WIDTH * Lightmaps::BLOCK_HEIGHT * 8 : used;
+	}
+
+	return usage;
+}
+
+MemoryReport::Usage MemoryReport::Measure(const MapLoader& loader)
+{
+	Usage usage;
+	usage.bytes[MemoryCategory::MapSource]   += loader.GetMapDataBytes();
+	usage.bytes[MemoryCategory::TextureHost] += loader.GetDecodedBytes();
+	return usage;
+}
+
+}
@@ -0,0 +1,196 @@
+#include "quake/PakFile.h"
+
+#include <algorithm>
+
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // _WIN32
+
+namespace
+{
+
+static const int NAME_LEN = 56;
+
+struct PakHeader
+{
+	char    magic[4];               // "PACK"
+	int32_t diroffset;              // Position of directory in file
+	int32_t dirsize;                // Size of directory, in bytes
+};
+
+struct PakEntry
+{
+	char    name[NAME_LEN];         // '\0'-padded, '/' separated
+	int32_t offset;                 // Position of the entry in pak
+	int32_t size;                   // Size of the entry
+};
+
+}
+
+namespace quake
+{
+
+PakFile::PakFile()
+	: m_data(nullptr)
+	, m_size(0)
+#ifdef _WIN32
+	, m_file_handle(INVALID_HANDLE_VALUE)
+	, m_map_handle(nullptr)
+#endif // _WIN32
+{
+}
+
+PakFile::~PakFile()
+{
+	Close();
+}
+
+bool PakFile::Open(const std::string& filepath)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE map = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!map) {
+		CloseHandle(file);
+		return false;
+	}
+	void* view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		CloseHandle(map);
+		CloseHandle(file);
+		return false;
+	}
+	m_file_handle = file;
+	m_map_handle  = map;
+	m_data = static_cast<const unsigned char*>(view);
+	m_size = static_cast<size_t>(size.QuadPart);
+#else
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps its own reference to the file
+	close(fd);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+	m_data = static_cast<const unsigned char*>(view);
+	m_size = static_cast<size_t>(st.st_size);
+#endif // _WIN32
+
+	m_filepath = filepath;
+
+	if (!ParseDirectory()) {
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void PakFile::Close()
+{
+	if (m_data)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+		CloseHandle(m_map_handle);
+		CloseHandle(m_file_handle);
+		m_file_handle = INVALID_HANDLE_VALUE;
+		m_map_handle  = nullptr;
+#else
+		munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif // _WIN32
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+
+	m_filepath.clear();
+	m_entries.clear();
+}
+
+PakFileData PakFile::GetFileData(const Entry& entry) const
+{
+	PakFileData ret;
+	ret.data = m_data + entry.offset;
+	ret.size = entry.size;
+	return ret;
+}
+
+std::string PakFile::NormalizePath(const std::string& path)
+{
+	std::string ret = path;
+	std::transform(ret.begin(), ret.end(), ret.begin(), [](char c) {
+		return c == '\\' ? '/' : static_cast<char>(tolower(c));
+	});
+	size_t start = 0;
+	while (start < ret.size() && ret[start] == '/') {
+		++start;
+	}
+	return ret.substr(start);
+}
+
+bool PakFile::ParseDirectory()
+{
+	if (m_size < sizeof(PakHeader)) {
+		return false;
+	}
+
+	PakHeader header;
+	memcpy(&header, m_data, sizeof(header));
+	if (strncmp(header.magic, "PACK", 4) != 0) {
+		return false;
+	}
+	if (header.diroffset < 0 || header.dirsize < 0 ||
+		static_cast<size_t>(header.diroffset) + header.dirsize > m_size) {
+		return false;
+	}
+
+	const size_t num = header.dirsize / sizeof(PakEntry);
+	m_entries.reserve(num);
+	for (size_t i = 0; i < num; ++i)
+	{
+		PakEntry src;
+		memcpy(&src, m_data + header.diroffset + i * sizeof(PakEntry), sizeof(src));
+		if (src.offset < 0 || src.size < 0 ||
+			static_cast<size_t>(src.offset) + src.size > m_size) {
+			continue;
+		}
+
+		Entry dst;
+		dst.name   = NormalizePath(std::string(src.name, strnlen(src.name, NAME_LEN)));
+		dst.offset = static_cast<uint32_t>(src.offset);
+		dst.size   = static_cast<uint32_t>(src.size);
+		m_entries.push_back(dst);
+	}
+
+	return true;
+}
+
+}
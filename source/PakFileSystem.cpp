@@ -0,0 +1,68 @@
+#include "quake/PakFileSystem.h"
+
+namespace quake
+{
+
+bool PakFileSystem::Mount(const std::string& pak_filepath)
+{
+	auto pak = std::make_unique<PakFile>();
+	if (!pak->Open(pak_filepath)) {
+		return false;
+	}
+
+	const size_t pak_idx = m_paks.size();
+	auto& entries = pak->GetEntries();
+	for (size_t i = 0, n = entries.size(); i < n; ++i) {
+		m_dir[entries[i].name] = { pak_idx, i };
+	}
+	m_paks.push_back(std::move(pak));
+
+	return true;
+}
+
+size_t PakFileSystem::MountGameDir(const std::string& dir)
+{
+	size_t count = 0;
+	while (Mount(dir + "/pak" + std::to_string(count) + ".pak")) {
+		++count;
+	}
+	return count;
+}
+
+void PakFileSystem::Clear()
+{
+	m_dir.clear();
+	m_paks.clear();
+}
+
+bool PakFileSystem::Exists(const std::string& path) const
+{
+	return m_dir.find(PakFile::NormalizePath(path)) != m_dir.end();
+}
+
+PakFileData PakFileSystem::Find(const std::string& path) const
+{
+	auto itr = m_dir.find(PakFile::NormalizePath(path));
+	if (itr == m_dir.end()) {
+		return PakFileData();
+	}
+
+	auto& pak = m_paks[itr->second.pak_idx];
+	return pak->GetFileData(pak->GetEntries()[itr->second.entry_idx]);
+}
+
+std::vector<std::string> PakFileSystem::ListFiles(const std::string& ext) const
+{
+	std::vector<std::string> ret;
+	for (auto& itr : m_dir)
+	{
+		auto& name = itr.first;
+		if (ext.empty() ||
+			(name.size() >= ext.size() && name.compare(name.size() - ext.size(), ext.size(), ext) == 0)) {
+			ret.push_back(name);
+		}
+	}
+	return ret;
+}
+
+}
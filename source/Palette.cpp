@@ -1,5 +1,6 @@
 #include "quake/Palette.h"
 #include "quake/ColorMap.h"
+#include "quake/Profiler.h"
 
 #include <boost/filesystem.hpp>
 
@@ -37,9 +38,41 @@ void Palette::LoadFromFile(const std::string& filepath)
 	}
 }
 
+void Palette::LoadFromMemory(const unsigned char* data, size_t size)
+{
+	if (m_data) {
+		delete[] m_data;
+	}
+
+	m_size = size;
+	m_data = new unsigned char[m_size];
+	memcpy(m_data, data, m_size);
+}
+
+uint64_t Palette::GetHash() const
+{
+	const unsigned char* data = m_data;
+	size_t size = m_size;
+	if (!data) {
+		data = &COLOR_MAP[0][0];
+		size = sizeof(COLOR_MAP);
+	}
+
+	// FNV-1a
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; ++i) {
+		h ^= data[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
 void Palette::IndexedToRgb(const unsigned char* indexed, size_t size,
 	                       unsigned char* rgb) const
 {
+	QUAKE_PROFILE_SCOPE("Palette::IndexedToRgb");
+	QUAKE_PROFILE_COUNTER(BytesDecoded, size * 3);
+
 	if (m_data)
 	{
 		for (size_t i = 0; i < size; ++i)
@@ -0,0 +1,213 @@
+#include "quake/Profiler.h"
+
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+namespace quake
+{
+
+const char* ProfileCounter::Name(Type type)
+{
+	switch (type)
+	{
+	case Tokens:
+		return "tokens";
+	case Entities:
+		return "entities";
+	case Brushes:
+		return "brushes";
+	case Faces:
+		return "faces";
+	case Textures:
+		return "textures";
+	case BytesDecoded:
+		return "bytes_decoded";
+	case BytesUploaded:
+		return "bytes_uploaded";
+	case Allocations:
+		return "allocations";
+	case LightmapBlocks:
+		return "lightmap_blocks";
+	case BlocksCompressed:
+		return "blocks_compressed";
+	default:
+		return "unknown";
+	}
+}
+
+namespace
+{
+
+thread_local Profiler* CURRENT = nullptr;
+
+}
+
+Profiler::Profiler()
+	: m_enabled(false)
+	, m_epoch(std::chrono::steady_clock::now())
+	, m_max_events(DEFAULT_MAX_EVENTS)
+	, m_dropped_events(0)
+{
+	for (auto& c : m_counters) {
+		c = 0;
+	}
+}
+
+void Profiler::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+
+	m_events.clear();
+	m_dropped_events = 0;
+	m_phases.clear();
+	for (auto& c : m_counters) {
+		c = 0;
+	}
+	m_epoch = std::chrono::steady_clock::now();
+}
+
+uint64_t Profiler::NowNS() const
+{
+	auto d = std::chrono::steady_clock::now() - m_epoch;
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+void Profiler::AddEvent(const char* name, uint64_t begin_ns, uint64_t end_ns)
+{
+	const uint64_t dur = end_ns > begin_ns ? end_ns - begin_ns : 0;
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+	if (m_events.size() < m_max_events) {
+		m_events.push_back({ name, begin_ns, dur, ThreadID() });
+	} else {
+		++m_dropped_events;
+	}
+	AddPhase(name, dur, 1);
+}
+
+void Profiler::AddTimer(const char* name, const ProfileTimer& timer)
+{
+	if (timer.count == 0) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+	AddPhase(name, timer.total_ns, timer.count);
+}
+
+Profiler::Summary Profiler::GetSummary() const
+{
+	Summary ret;
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+	for (auto& itr : m_phases) {
+		ret.phases.push_back(itr.second);
+	}
+	for (int i = 0; i < ProfileCounter::MaxCount; ++i) {
+		ret.counters[i] = m_counters[i];
+	}
+	ret.dropped_events = m_dropped_events;
+
+	return ret;
+}
+
+std::string Profiler::ToChromeTrace() const
+{
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(3);
+	ss << "{\"traceEvents\":[";
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+
+	bool first = true;
+	uint64_t last_ns = 0;
+	for (auto& e : m_events)
+	{
+		if (!first) {
+			ss << ",";
+		}
+		first = false;
+		ss << "\n{\"name\":\"" << e.name << "\",\"cat\":\"quake\",\"ph\":\"X\",\"ts\":" << e.begin_ns / 1000.0
+		   << ",\"dur\":" << e.dur_ns / 1000.0 << ",\"pid\":1,\"tid\":" << e.tid << "}";
+		last_ns = std::max(last_ns, e.begin_ns + e.dur_ns);
+	}
+
+	for (int i = 0; i < ProfileCounter::MaxCount; ++i)
+	{
+		if (!first) {
+			ss << ",";
+		}
+		first = false;
+		ss << "\n{\"name\":\"" << ProfileCounter::Name(static_cast<ProfileCounter::Type>(i))
+		   << "\",\"cat\":\"quake\",\"ph\":\"C\",\"ts\":" << last_ns / 1000.0
+		   << ",\"pid\":1,\"args\":{\"value\":" << m_counters[i] << "}}";
+	}
+
+	ss << "\n]}\n";
+	return ss.str();
+}
+
+bool Profiler::WriteChromeTrace(const std::string& filepath) const
+{
+	std::ofstream fout(filepath, std::ios::binary);
+	if (fout.fail()) {
+		return false;
+	}
+	fout << ToChromeTrace();
+	return !fout.fail();
+}
+
+Profiler* Profiler::Instance()
+{
+	// initialized once even when the first calls race, and never destroyed
+	// so scopes closing during static destruction still have it
+	static Profiler* prof = new Profiler();
+	return prof;
+}
+
+Profiler* Profiler::Current()
+{
+	return CURRENT ? CURRENT : Instance();
+}
+
+void Profiler::AddPhase(const char* name, uint64_t total_ns, uint64_t count)
+{
+	auto& phase = m_phases[name];
+	if (phase.name.empty()) {
+		phase.name = name;
+	}
+	phase.count    += count;
+	phase.total_ms += total_ns / 1000000.0;
+}
+
+uint32_t Profiler::ThreadID()
+{
+	const size_t key = std::hash<std::thread::id>()(std::this_thread::get_id());
+	auto itr = m_thread_ids.find(key);
+	if (itr != m_thread_ids.end()) {
+		return itr->second;
+	}
+
+	const uint32_t id = static_cast<uint32_t>(m_thread_ids.size()) + 1;
+	m_thread_ids.insert({ key, id });
+	return id;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// class ProfileBind
+//////////////////////////////////////////////////////////////////////////
+
+ProfileBind::ProfileBind(Profiler* prof)
+	: m_prev(CURRENT)
+{
+	CURRENT = prof;
+}
+
+ProfileBind::~ProfileBind()
+{
+	CURRENT = m_prev;
+}
+
+}
\ No newline at end of file
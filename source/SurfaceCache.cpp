@@ -0,0 +1,264 @@
+#include "quake/SurfaceCache.h"
+#include "quake/Palette.h"
+#include "quake/Lightmaps.h"
+#include "quake/SIMD.h"
+#include "quake/Profiler.h"
+
+#include <algorithm>
+
+#include <limits.h>
+
+namespace
+{
+
+// palette indices from here on aren't affected by light
+const int FULLBRIGHT_BEGIN = 224;
+
+// luxel value of the texture as is, what surfaces without lightmap get
+const uint16_t UNLIT_LUXEL = 128;
+
+// luxels are 16 texels apart at mip 0
+const int LUXEL_SHIFT = 4;
+
+inline uint64_t EntryKey(uint32_t face, int mip)
+{
+	return (static_cast<uint64_t>(face) << 8) | static_cast<uint64_t>(mip);
+}
+
+inline int Wrap(int v, int size)
+{
+	v %= size;
+	return v < 0 ? v + size : v;
+}
+
+// light * bs * bs along a row, from the column values col * bs which are
+// bs texels apart
+void InterpolateRow(const uint16_t* cols, int bs_shift, int width, uint16_t* light)
+{
+	const int bs = 1 << bs_shift;
+	int x = 0;
+#ifdef QUAKE_SIMD_SSE2
+	if (bs >= 8)
+	{
+		const __m128i step0 = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m128i bs8 = _mm_set1_epi16(static_cast<short>(bs));
+		for (int cx = 0; x + 8 <= width; ++cx)
+		{
+			const __m128i a = _mm_set1_epi16(static_cast<short>(cols[cx]));
+			const __m128i b = _mm_set1_epi16(static_cast<short>(cols[cx + 1]));
+			for (int fx = 0; fx < bs && x + 8 <= width; fx += 8, x += 8)
+			{
+				const __m128i f = _mm_add_epi16(step0, _mm_set1_epi16(static_cast<short>(fx)));
+				// products and sum stay below 65536, low 16 bits are exact
+				const __m128i v = _mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(bs8, f)),
+					_mm_mullo_epi16(b, f));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(light + x), v);
+			}
+		}
+	}
+#endif // QUAKE_SIMD_SSE2
+	for ( ; x < width; ++x)
+	{
+		const int cx = x >> bs_shift;
+		const int fx = x & (bs - 1);
+		light[x] = static_cast<uint16_t>(cols[cx] * (bs - fx) + cols[cx + 1] * fx);
+	}
+}
+
+}
+
+namespace quake
+{
+
+SurfaceCache::SurfaceCache(const Palette& palette, const Lightmaps& lightmaps, size_t budget_bytes)
+	: m_lightmaps(lightmaps)
+	, m_budget(budget_bytes)
+{
+	BuildLightTable(palette);
+}
+
+const SurfaceCache::Entry* SurfaceCache::Get(uint32_t face, int mip, const Surface& surface)
+{
+	if (!surface.texture || mip < 0 || mip >= WadFileLoader::MIP_LEVELS) {
+		return nullptr;
+	}
+
+	const uint64_t key = EntryKey(face, mip);
+	auto itr = m_entries.find(key);
+	if (itr != m_entries.end())
+	{
+		auto& entry = *itr->second;
+		m_lru.splice(m_lru.begin(), m_lru, itr->second);
+		if (entry.light_version == surface.light_version) {
+			++m_stats.hits;
+			return &entry;
+		}
+
+		++m_stats.misses;
+		m_stats.bytes -= entry.pixels.size();
+		Build(surface, mip, entry);
+		m_stats.bytes += entry.pixels.size();
+	}
+	else
+	{
+		++m_stats.misses;
+		m_lru.emplace_front();
+		auto& entry = m_lru.front();
+		entry.face = face;
+		entry.mip  = mip;
+		Build(surface, mip, entry);
+		m_stats.bytes += entry.pixels.size();
+		m_entries.insert({ key, m_lru.begin() });
+	}
+
+	Evict();
+
+	return &m_lru.front();
+}
+
+void SurfaceCache::Clear()
+{
+	m_lru.clear();
+	m_entries.clear();
+	m_stats.bytes = 0;
+}
+
+void SurfaceCache::BuildLightTable(const Palette& palette)
+{
+	uint8_t indices[256];
+	for (int i = 0; i < 256; ++i) {
+		indices[i] = static_cast<uint8_t>(i);
+	}
+	uint8_t rgb[256 * 3];
+	palette.IndexedToRgb(indices, 256, rgb);
+
+	// each row scales the colors by (64 - row) / 32 and takes the nearest
+	// lit color, as quake's colormap.lmp
+	m_light_table.resize(LIGHT_LEVELS * 256);
+	for (int row = 0; row < LIGHT_LEVELS; ++row)
+	{
+		uint8_t* dst = &m_light_table[row * 256];
+		for (int i = 0; i < 256; ++i)
+		{
+			if (i >= FULLBRIGHT_BEGIN) {
+				dst[i] = static_cast<uint8_t>(i);
+				continue;
+			}
+
+			int c[3];
+			for (int j = 0; j < 3; ++j) {
+				c[j] = std::min(255, rgb[i * 3 + j] * (64 - row) / 32);
+			}
+
+			int best = 0, best_dist = INT_MAX;
+			for (int k = 0; k < FULLBRIGHT_BEGIN; ++k)
+			{
+				const int dr = c[0] - rgb[k * 3];
+				const int dg = c[1] - rgb[k * 3 + 1];
+				const int db = c[2] - rgb[k * 3 + 2];
+				const int dist = dr * dr + dg * dg + db * db;
+				if (dist < best_dist) {
+					best_dist = dist;
+					best = k;
+				}
+			}
+			dst[i] = static_cast<uint8_t>(best);
+		}
+	}
+}
+
+void SurfaceCache::Build(const Surface& surface, int mip, Entry& entry) const
+{
+	QUAKE_PROFILE_SCOPE("SurfaceCache::Build");
+
+	entry.light_version = surface.light_version;
+
+	auto& tex = *surface.texture;
+
+	// a missing level is sampled from mip 0
+	const int src_mip = tex.mips[mip].empty() ? 0 : mip;
+	const int stride = 1 << (mip - src_mip);
+	const int tw = std::max(1, static_cast<int>(tex.width >> src_mip));
+	const int th = std::max(1, static_cast<int>(tex.height >> src_mip));
+	auto& src = tex.mips[src_mip];
+
+	const int w = std::max(1, surface.extents[0] >> mip);
+	const int h = std::max(1, surface.extents[1] >> mip);
+	entry.width  = w;
+	entry.height = h;
+	entry.pixels.resize(w * h);
+	if (src.size() < static_cast<size_t>(tw * th)) {
+		std::fill(entry.pixels.begin(), entry.pixels.end(), 0);
+		return;
+	}
+
+	const int s0 = surface.texture_mins[0] >> mip;
+	const int t0 = surface.texture_mins[1] >> mip;
+
+	// luxel intensities, plus one column and row of padding for the filter
+	const int bs_shift = std::max(0, LUXEL_SHIFT - mip);
+	const int bs = 1 << bs_shift;
+	const int lw = (surface.extents[0] >> LUXEL_SHIFT) + 1;
+	const int lh = (surface.extents[1] >> LUXEL_SHIFT) + 1;
+	std::vector<uint16_t> luxels((lw + 1) * (lh + 1));
+	for (int j = 0; j <= lh; ++j)
+	{
+		for (int i = 0; i <= lw; ++i)
+		{
+			uint16_t v = UNLIT_LUXEL;
+			if (surface.lightmap >= 0)
+			{
+				v = static_cast<uint16_t>(m_lightmaps.GetIntensity(surface.lightmap,
+					surface.light_s + std::min(i, lw - 1), surface.light_t + std::min(j, lh - 1)));
+			}
+			luxels[j * (lw + 1) + i] = v;
+		}
+	}
+
+	// vertical filter into the luxel columns, then horizontal along the row.
+	// texel w - 1 is in luxel column lw - 1, so lw is the last one read
+	std::vector<uint16_t> cols(lw + 1);
+	std::vector<uint16_t> light(w);
+	for (int y = 0; y < h; ++y)
+	{
+		const int cy = y >> bs_shift;
+		const int fy = y & (bs - 1);
+		const uint16_t* l0 = &luxels[cy * (lw + 1)];
+		const uint16_t* l1 = &luxels[(cy + 1) * (lw + 1)];
+		for (int cx = 0; cx <= lw; ++cx) {
+			cols[cx] = static_cast<uint16_t>(l0[cx] * (bs - fy) + l1[cx] * fy);
+		}
+		InterpolateRow(cols.data(), bs_shift, w, light.data());
+
+		const uint8_t* src_row = &src[Wrap((t0 + y) * stride, th) * tw];
+		uint8_t* dst = &entry.pixels[y * w];
+		int u = Wrap(s0 * stride, tw);
+		for (int x = 0; x < w; ++x)
+		{
+			// luxel 128 is the texture as is, 255 about twice as bright
+			const int v = light[x] >> (2 * bs_shift);
+			const int row = std::min(LIGHT_LEVELS - 1, 64 - (v >> 2));
+			dst[x] = m_light_table[(row << 8) + src_row[u]];
+
+			u += stride;
+			while (u >= tw) {
+				u -= tw;
+			}
+		}
+	}
+}
+
+void SurfaceCache::Evict()
+{
+	// never the front, it's what Get() returns
+	while (m_stats.bytes > m_budget && m_lru.size() > 1)
+	{
+		auto& entry = m_lru.back();
+		m_stats.bytes -= entry.pixels.size();
+		m_entries.erase(EntryKey(entry.face, entry.mip));
+		m_lru.pop_back();
+		++m_stats.evictions;
+	}
+}
+
+}
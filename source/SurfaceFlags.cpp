@@ -0,0 +1,72 @@
+#include "quake/SurfaceFlags.h"
+
+#include <string.h>
+
+namespace
+{
+
+inline bool StartsWith(const char* str, const char* prefix)
+{
+	return strncmp(str, prefix, strlen(prefix)) == 0;
+}
+
+}
+
+namespace quake
+{
+
+FaceSurface GetTextureSurface(const std::string& tex_name)
+{
+	FaceSurface ret;
+
+	// names are lowercase once parsed
+	auto slash = tex_name.find_last_of('/');
+	const char* name = tex_name.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+
+	if (name[0] == '*')
+	{
+		ret.flags = SurfaceFlags::Warp;
+		if (StartsWith(name + 1, "lava")) {
+			ret.contents = ContentFlags::Lava;
+		} else if (StartsWith(name + 1, "slime")) {
+			ret.contents = ContentFlags::Slime;
+		} else {
+			ret.contents = ContentFlags::Water;
+		}
+	}
+	else if (StartsWith(name, "sky"))
+	{
+		ret.flags = SurfaceFlags::Sky;
+	}
+	else if (strcmp(name, "clip") == 0)
+	{
+		ret.contents = ContentFlags::PlayerClip | ContentFlags::MonsterClip;
+		ret.flags    = SurfaceFlags::NoDraw;
+	}
+	else if (strcmp(name, "trigger") == 0)
+	{
+		ret.contents = ContentFlags::Trigger;
+		ret.flags    = SurfaceFlags::NoDraw;
+	}
+	else if (strcmp(name, "origin") == 0)
+	{
+		ret.contents = ContentFlags::Origin;
+		ret.flags    = SurfaceFlags::NoDraw;
+	}
+	else if (strcmp(name, "skip") == 0 || strcmp(name, "hintskip") == 0)
+	{
+		ret.flags = SurfaceFlags::Skip;
+	}
+	else if (strcmp(name, "hint") == 0)
+	{
+		ret.flags = SurfaceFlags::Hint;
+	}
+	else if (strcmp(name, "nodraw") == 0)
+	{
+		ret.flags = SurfaceFlags::NoDraw;
+	}
+
+	return ret;
+}
+
+}
@@ -0,0 +1,50 @@
+#include "quake/TaskPool.h"
+
+#include <algorithm>
+
+namespace quake
+{
+
+TaskPool::TaskPool(size_t threads)
+{
+	if (threads == 0) {
+		threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+	}
+	m_workers.reserve(threads);
+	for (size_t i = 0; i < threads; ++i) {
+		m_workers.emplace_back([this]() { WorkerLoop(); });
+	}
+}
+
+TaskPool::~TaskPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+	for (auto& w : m_workers) {
+		w.join();
+	}
+}
+
+void TaskPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mtx);
+			m_cv.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+			// finish the queued tasks before stopping
+			if (m_tasks.empty()) {
+				return;
+			}
+			task = std::move(m_tasks.front());
+			m_tasks.pop();
+		}
+		task();
+	}
+}
+
+}
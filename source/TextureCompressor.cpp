@@ -0,0 +1,397 @@
+#include "quake/TextureCompressor.h"
+#include "quake/ParallelFor.h"
+#include "quake/SIMD.h"
+#include "quake/Profiler.h"
+
+#include <algorithm>
+
+#include <math.h>
+
+namespace
+{
+
+// rows of blocks per task
+const size_t ROW_GRAIN = 16;
+
+const int POWER_ITERATIONS = 4;
+const int REFINE_ITERATIONS = 2;
+
+// 16 texels of rgba, edge blocks repeat the last row and column
+void LoadBlock(const uint8_t* pixels, int channels, uint32_t width, uint32_t height,
+	           uint32_t bx, uint32_t by, uint8_t* rgba)
+{
+	for (uint32_t y = 0; y < 4; ++y)
+	{
+		const uint32_t sy = std::min(by * 4 + y, height - 1);
+		for (uint32_t x = 0; x < 4; ++x)
+		{
+			const uint32_t sx = std::min(bx * 4 + x, width - 1);
+			const uint8_t* src = pixels + (sy * width + sx) * channels;
+			uint8_t* dst = rgba + (y * 4 + x) * 4;
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+			dst[3] = channels == 4 ? src[3] : 255;
+		}
+	}
+}
+
+inline uint16_t To565(const int c[3])
+{
+	const int r = (c[0] * 31 + 127) / 255;
+	const int g = (c[1] * 63 + 127) / 255;
+	const int b = (c[2] * 31 + 127) / 255;
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+// as the hardware expands them
+inline void From565(uint16_t v, int c[3])
+{
+	const int r = (v >> 11) & 31;
+	const int g = (v >> 5) & 63;
+	const int b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+void EndpointsFromBox(const uint8_t* rgba, int c0[3], int c1[3])
+{
+	int mn[3] = { 255, 255, 255 };
+	int mx[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			mn[j] = std::min(mn[j], static_cast<int>(rgba[i * 4 + j]));
+			mx[j] = std::max(mx[j], static_cast<int>(rgba[i * 4 + j]));
+		}
+	}
+
+	// inset by 1/16 of the range, the extremes are rarely worth an endpoint
+	for (int j = 0; j < 3; ++j)
+	{
+		const int inset = (mx[j] - mn[j]) >> 4;
+		c0[j] = mx[j] - inset;
+		c1[j] = mn[j] + inset;
+	}
+}
+
+// the texels farthest apart along the principal axis of the colors
+void EndpointsFromAxis(const uint8_t* rgba, int c0[3], int c1[3])
+{
+	float mean[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			mean[j] += rgba[i * 4 + j];
+		}
+	}
+	for (int j = 0; j < 3; ++j) {
+		mean[j] /= 16.0f;
+	}
+
+	float cov[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int i = 0; i < 16; ++i)
+	{
+		const float r = rgba[i * 4]     - mean[0];
+		const float g = rgba[i * 4 + 1] - mean[1];
+		const float b = rgba[i * 4 + 2] - mean[2];
+		cov[0] += r * r;
+		cov[1] += r * g;
+		cov[2] += r * b;
+		cov[3] += g * g;
+		cov[4] += g * b;
+		cov[5] += b * b;
+	}
+
+	float axis[3] = { 1, 1, 1 };
+	for (int k = 0; k < POWER_ITERATIONS; ++k)
+	{
+		const float x = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+		const float y = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+		const float z = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+		const float m = std::max(fabsf(x), std::max(fabsf(y), fabsf(z)));
+		if (m < 1e-6f) {
+			break;
+		}
+		axis[0] = x / m;
+		axis[1] = y / m;
+		axis[2] = z / m;
+	}
+
+	int i_min = 0, i_max = 0;
+	float d_min = 0, d_max = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		const float d = rgba[i * 4] * axis[0] + rgba[i * 4 + 1] * axis[1] + rgba[i * 4 + 2] * axis[2];
+		if (i == 0 || d < d_min) {
+			d_min = d;
+			i_min = i;
+		}
+		if (i == 0 || d > d_max) {
+			d_max = d;
+			i_max = i;
+		}
+	}
+	for (int j = 0; j < 3; ++j) {
+		c0[j] = rgba[i_max * 4 + j];
+		c1[j] = rgba[i_min * 4 + j];
+	}
+}
+
+// index of each texel to the colors p0, p1, (2p0+p1)/3, (p0+2p1)/3, two
+// bits per texel. texels are placed on the line from p1 to p0 and rounded
+// to the nearest third: 0 is p1, 1 is (p0+2p1)/3, 2 is (2p0+p1)/3, 3 is p0
+uint32_t MatchColors(const uint8_t* rgba, const int p0[3], const int p1[3])
+{
+	const int dir[3] = { p0[0] - p1[0], p0[1] - p1[1], p0[2] - p1[2] };
+	const int len2 = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+	if (len2 == 0) {
+		return 0;
+	}
+	const int base = p1[0] * dir[0] + p1[1] * dir[1] + p1[2] * dir[2];
+
+	static const uint32_t THIRD_TO_INDEX[4] = { 1, 3, 2, 0 };
+
+	uint32_t ret = 0;
+	int i = 0;
+#ifdef QUAKE_SIMD_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i d16 = _mm_setr_epi16(
+		static_cast<short>(dir[0]), static_cast<short>(dir[1]), static_cast<short>(dir[2]), 0,
+		static_cast<short>(dir[0]), static_cast<short>(dir[1]), static_cast<short>(dir[2]), 0);
+	const __m128i base4 = _mm_set1_epi32(base);
+	const __m128i t1 = _mm_set1_epi32(len2);
+	const __m128i t3 = _mm_set1_epi32(len2 * 3);
+	const __m128i t5 = _mm_set1_epi32(len2 * 5);
+	for ( ; i < 16; i += 4)
+	{
+		const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+		// rg and b0 halves of the dot product for two texels each
+		const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), d16);
+		const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), d16);
+		const __m128i even = _mm_castps_si128(_mm_shuffle_ps(
+			_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+		const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(
+			_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+		const __m128i v = _mm_sub_epi32(_mm_add_epi32(even, odd), base4);
+		// 6 * v against the odd multiples of len2 gives the rounded third
+		const __m128i v6 = _mm_add_epi32(_mm_slli_epi32(v, 2), _mm_slli_epi32(v, 1));
+		const __m128i thirds = _mm_sub_epi32(zero, _mm_add_epi32(_mm_cmpgt_epi32(v6, t1),
+			_mm_add_epi32(_mm_cmpgt_epi32(v6, t3), _mm_cmpgt_epi32(v6, t5))));
+
+		alignas(16) int32_t k[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(k), thirds);
+		for (int j = 0; j < 4; ++j) {
+			ret |= THIRD_TO_INDEX[k[j]] << ((i + j) * 2);
+		}
+	}
+#endif // QUAKE_SIMD_SSE2
+	for ( ; i < 16; ++i)
+	{
+		const uint8_t* c = rgba + i * 4;
+		const int v6 = 6 * (c[0] * dir[0] + c[1] * dir[1] + c[2] * dir[2] - base);
+		const int k = (v6 > len2) + (v6 > len2 * 3) + (v6 > len2 * 5);
+		ret |= THIRD_TO_INDEX[k] << (i * 2);
+	}
+	return ret;
+}
+
+void BuildPalette(uint16_t c0, uint16_t c1, int pal[4][3])
+{
+	From565(c0, pal[0]);
+	From565(c1, pal[1]);
+	for (int j = 0; j < 3; ++j) {
+		pal[2][j] = (2 * pal[0][j] + pal[1][j]) / 3;
+		pal[3][j] = (pal[0][j] + 2 * pal[1][j]) / 3;
+	}
+}
+
+int CalcError(const uint8_t* rgba, const int pal[4][3], uint32_t indices)
+{
+	int err = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		auto& p = pal[(indices >> (i * 2)) & 3];
+		for (int j = 0; j < 3; ++j) {
+			const int d = rgba[i * 4 + j] - p[j];
+			err += d * d;
+		}
+	}
+	return err;
+}
+
+// least squares endpoints for the given indices, false if they are degenerate
+bool RefineEndpoints(const uint8_t* rgba, uint32_t indices, int c0[3], int c1[3])
+{
+	static const float WEIGHT0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+	float aa = 0, bb = 0, ab = 0;
+	float ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; ++i)
+	{
+		const float a = WEIGHT0[(indices >> (i * 2)) & 3];
+		const float b = 1.0f - a;
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+		for (int j = 0; j < 3; ++j) {
+			ax[j] += a * rgba[i * 4 + j];
+			bx[j] += b * rgba[i * 4 + j];
+		}
+	}
+
+	const float det = aa * bb - ab * ab;
+	if (fabsf(det) < 1e-6f) {
+		return false;
+	}
+	for (int j = 0; j < 3; ++j)
+	{
+		const float e0 = (ax[j] * bb - bx[j] * ab) / det;
+		const float e1 = (bx[j] * aa - ax[j] * ab) / det;
+		c0[j] = std::min(255, std::max(0, static_cast<int>(e0 + 0.5f)));
+		c1[j] = std::min(255, std::max(0, static_cast<int>(e1 + 0.5f)));
+	}
+	return true;
+}
+
+void EncodeColor(const uint8_t* rgba, quake::TextureCompressor::Quality quality, uint8_t* out)
+{
+	typedef quake::TextureCompressor::Quality Quality;
+
+	int e0[3], e1[3];
+	if (quality == Quality::Fast) {
+		EndpointsFromBox(rgba, e0, e1);
+	} else {
+		EndpointsFromAxis(rgba, e0, e1);
+	}
+
+	// four color mode needs c0 > c1, equal endpoints are a solid block
+	uint16_t c0 = To565(e0), c1 = To565(e1);
+	if (c0 < c1) {
+		std::swap(c0, c1);
+	}
+	int pal[4][3];
+	BuildPalette(c0, c1, pal);
+	uint32_t indices = c0 == c1 ? 0 : MatchColors(rgba, pal[0], pal[1]);
+
+	if (quality == Quality::High && c0 != c1)
+	{
+		int err = CalcError(rgba, pal, indices);
+		for (int k = 0; k < REFINE_ITERATIONS && err > 0; ++k)
+		{
+			if (!RefineEndpoints(rgba, indices, e0, e1)) {
+				break;
+			}
+
+			uint16_t r0 = To565(e0), r1 = To565(e1);
+			if (r0 < r1) {
+				std::swap(r0, r1);
+			}
+			if (r0 == r1) {
+				break;
+			}
+			int r_pal[4][3];
+			BuildPalette(r0, r1, r_pal);
+			const uint32_t r_indices = MatchColors(rgba, r_pal[0], r_pal[1]);
+			const int r_err = CalcError(rgba, r_pal, r_indices);
+			if (r_err >= err) {
+				break;
+			}
+
+			c0 = r0;
+			c1 = r1;
+			indices = r_indices;
+			err = r_err;
+		}
+	}
+
+	out[0] = static_cast<uint8_t>(c0 & 0xff);
+	out[1] = static_cast<uint8_t>(c0 >> 8);
+	out[2] = static_cast<uint8_t>(c1 & 0xff);
+	out[3] = static_cast<uint8_t>(c1 >> 8);
+	for (int i = 0; i < 4; ++i) {
+		out[4 + i] = static_cast<uint8_t>(indices >> (i * 8));
+	}
+}
+
+// eight level mode, a0 > a1 with six steps between them
+void EncodeAlpha(const uint8_t* rgba, uint8_t* out)
+{
+	int a0 = 0, a1 = 255;
+	for (int i = 0; i < 16; ++i) {
+		a0 = std::max(a0, static_cast<int>(rgba[i * 4 + 3]));
+		a1 = std::min(a1, static_cast<int>(rgba[i * 4 + 3]));
+	}
+
+	uint64_t bits = 0;
+	if (a0 > a1)
+	{
+		const int range = a0 - a1;
+		for (int i = 0; i < 16; ++i)
+		{
+			// steps from a1 rounded, 7 is a0, 0 is a1, k between is index 8 - k
+			const int k = ((rgba[i * 4 + 3] - a1) * 14 + range) / (2 * range);
+			const uint64_t idx = k == 7 ? 0 : (k == 0 ? 1 : 8 - k);
+			bits |= idx << (i * 3);
+		}
+	}
+
+	out[0] = static_cast<uint8_t>(a0);
+	out[1] = static_cast<uint8_t>(a1);
+	for (int i = 0; i < 6; ++i) {
+		out[2 + i] = static_cast<uint8_t>(bits >> (i * 8));
+	}
+}
+
+}
+
+namespace quake
+{
+
+void TextureCompressor::Compress(const uint8_t* pixels, int channels, uint32_t width, uint32_t height,
+	                             Format format, Quality quality, uint8_t* out)
+{
+	QUAKE_PROFILE_SCOPE("TextureCompressor::Compress");
+
+	if (width == 0 || height == 0) {
+		return;
+	}
+
+	const uint32_t blocks_w = (width + 3) / 4;
+	const uint32_t blocks_h = (height + 3) / 4;
+	const size_t block_size = format == Format::BC1 ? 8 : 16;
+	ParallelFor(blocks_h, ROW_GRAIN, [&](size_t begin, size_t end)
+	{
+		alignas(16) uint8_t rgba[64];
+		for (size_t by = begin; by < end; ++by)
+		{
+			for (uint32_t bx = 0; bx < blocks_w; ++bx)
+			{
+				LoadBlock(pixels, channels, width, height, bx, static_cast<uint32_t>(by), rgba);
+				uint8_t* dst = out + (by * blocks_w + bx) * block_size;
+				if (format == Format::BC3) {
+					EncodeAlpha(rgba, dst);
+					dst += 8;
+				}
+				EncodeColor(rgba, quality, dst);
+			}
+		}
+	});
+
+	QUAKE_PROFILE_COUNTER(BlocksCompressed, blocks_w * blocks_h);
+}
+
+size_t TextureCompressor::CompressedSize(Format format, uint32_t width, uint32_t height)
+{
+	const size_t blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * (format == Format::BC1 ? 8 : 16);
+}
+
+ur::TextureFormat TextureCompressor::ToTextureFormat(Format format)
+{
+	// the endpoints are always ordered for four colors, dxt1 rgba decodes
+	// them as opaque
+	return format == Format::BC1 ? ur::TextureFormat::COMPRESSED_RGBA_S3TC_DXT1_EXT
+		                         : ur::TextureFormat::COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+}
@@ -0,0 +1,148 @@
+#include "quake/TextureDiskCache.h"
+#include "quake/Profiler.h"
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <thread>
+#include <functional>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+
+const char MAGIC[4] = { 'Q', 'B', 'C', 'T' };
+const uint32_t VERSION = 1;
+
+// larger levels mean a corrupt file
+const uint32_t MAX_DIMENSION = 1 << 14;
+
+struct FileHeader
+{
+	char     magic[4];
+	uint32_t version;
+	uint32_t format;
+	uint32_t levels;
+};
+
+struct LevelHeader
+{
+	uint32_t width;
+	uint32_t height;
+};
+
+}
+
+namespace quake
+{
+
+TextureDiskCache::TextureDiskCache(const std::string& dir)
+	: m_dir(dir)
+{
+	boost::system::error_code ec;
+	boost::filesystem::create_directories(m_dir, ec);
+}
+
+bool TextureDiskCache::Load(uint64_t hash, const TextureCompressor::Params& params,
+	                        TextureCompressor::Image& image) const
+{
+	QUAKE_PROFILE_SCOPE("TextureDiskCache::Load");
+
+	std::ifstream fin(FilePath(hash, params), std::ios::binary);
+	if (fin.fail()) {
+		return false;
+	}
+
+	FileHeader header;
+	fin.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (fin.fail() || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+		header.format != static_cast<uint32_t>(params.format) || header.levels == 0) {
+		return false;
+	}
+
+	TextureCompressor::Image ret;
+	ret.format = params.format;
+	ret.levels.resize(header.levels);
+	for (auto& level : ret.levels)
+	{
+		LevelHeader lh;
+		fin.read(reinterpret_cast<char*>(&lh), sizeof(lh));
+		if (fin.fail() || lh.width == 0 || lh.height == 0 ||
+			lh.width > MAX_DIMENSION || lh.height > MAX_DIMENSION) {
+			return false;
+		}
+
+		level.width  = lh.width;
+		level.height = lh.height;
+		level.data.resize(TextureCompressor::CompressedSize(params.format, lh.width, lh.height));
+		fin.read(reinterpret_cast<char*>(level.data.data()), level.data.size());
+		if (fin.fail()) {
+			return false;
+		}
+	}
+
+	image = std::move(ret);
+	return true;
+}
+
+bool TextureDiskCache::Store(uint64_t hash, const TextureCompressor::Params& params,
+	                         const TextureCompressor::Image& image) const
+{
+	QUAKE_PROFILE_SCOPE("TextureDiskCache::Store");
+
+	if (image.levels.empty()) {
+		return false;
+	}
+
+	// written aside and renamed, so readers never see half a file
+	const auto filepath = FilePath(hash, params);
+	const auto tmp_filepath = filepath + "." +
+		std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	{
+		std::ofstream fout(tmp_filepath, std::ios::binary);
+		if (fout.fail()) {
+			return false;
+		}
+
+		FileHeader header;
+		memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = VERSION;
+		header.format  = static_cast<uint32_t>(image.format);
+		header.levels  = static_cast<uint32_t>(image.levels.size());
+		fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		for (auto& level : image.levels)
+		{
+			const LevelHeader lh = { level.width, level.height };
+			fout.write(reinterpret_cast<const char*>(&lh), sizeof(lh));
+			fout.write(reinterpret_cast<const char*>(level.data.data()), level.data.size());
+		}
+
+		fout.close();
+		if (fout.fail()) {
+			remove(tmp_filepath.c_str());
+			return false;
+		}
+	}
+
+	// another thread may have stored the same texture first
+	if (rename(tmp_filepath.c_str(), filepath.c_str()) != 0) {
+		remove(tmp_filepath.c_str());
+		return boost::filesystem::exists(filepath);
+	}
+	return true;
+}
+
+std::string TextureDiskCache::FilePath(uint64_t hash, const TextureCompressor::Params& params) const
+{
+	static const char* FORMAT_NAMES[] = { "bc1", "bc3" };
+
+	char name[64];
+	snprintf(name, sizeof(name), "%016llx_%s_q%d%s.bct", static_cast<unsigned long long>(hash),
+		FORMAT_NAMES[static_cast<int>(params.format)], static_cast<int>(params.quality),
+		params.mips ? "_mips" : "");
+	return (boost::filesystem::path(m_dir) / name).string();
+}
+
+}
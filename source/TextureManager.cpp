@@ -1,14 +1,23 @@
 #include "quake/TextureManager.h"
+#include "quake/MapContext.h"
+#include "quake/MemoryReport.h"
+
+#include <unirender/Texture.h>
+
+#include <unordered_set>
 
 namespace quake
 {
 
-CU_SINGLETON_DEFINITION(TextureManager);
-
 TextureManager::TextureManager()
 {
 }
 
+TextureManager* TextureManager::Instance()
+{
+	return &MapContext::Default().GetTextures();
+}
+
 void TextureManager::Add(const std::string& name, ur::TexturePtr& tex)
 {
 	m_name2tex.insert({ name, tex });
@@ -20,4 +29,112 @@ ur::TexturePtr TextureManager::Query(const std::string& name) const
 	return itr == m_name2tex.end() ? nullptr : itr->second;
 }
 
+void TextureManager::Add(const std::string& name, ur::TexturePtr& tex, uint64_t hash,
+	                     int width, int height, size_t bytes)
+{
+	// the first one added under a name stays, as in m_name2tex
+	Add(name, tex);
+	m_sizes.insert({ name, { width, height } });
+
+	Upload upload;
+	upload.tex    = tex;
+	upload.width  = width;
+	upload.height = height;
+	upload.bytes  = bytes > 0 ? bytes : static_cast<size_t>(width) * height * 3;
+	m_hash2tex.insert({ hash, upload });
+}
+
+ur::TexturePtr TextureManager::QueryByHash(uint64_t hash) const
+{
+	auto itr = m_hash2tex.find(hash);
+	return itr == m_hash2tex.end() ? nullptr : itr->second.tex;
+}
+
+bool TextureManager::AddShared(const std::string& name, uint64_t hash, size_t bytes)
+{
+	auto itr = m_hash2tex.find(hash);
+	if (itr == m_hash2tex.end()) {
+		return false;
+	}
+
+	Add(name, itr->second.tex);
+	m_sizes.insert({ name, { itr->second.width, itr->second.height } });
+
+	++m_share_stats.textures;
+	m_share_stats.bytes_saved += bytes;
+
+	return true;
+}
+
+void TextureManager::AddPartial(const std::string& name, ur::TexturePtr& tex, int width, int height)
+{
+	Add(name, tex);
+	m_sizes[name] = { width, height };
+}
+
+bool TextureManager::Upgrade(const std::string& name, ur::TexturePtr& tex)
+{
+	auto itr = m_name2tex.find(name);
+	if (itr == m_name2tex.end()) {
+		return false;
+	}
+	itr->second = tex;
+	return true;
+}
+
+bool TextureManager::QuerySize(const std::string& name, int& width, int& height) const
+{
+	auto size = m_sizes.find(name);
+	if (size != m_sizes.end()) {
+		width  = size->second.first;
+		height = size->second.second;
+		return true;
+	}
+
+	auto tex = Query(name);
+	if (!tex) {
+		return false;
+	}
+	width  = tex->GetWidth();
+	height = tex->GetHeight();
+	return true;
+}
+
+size_t TextureManager::GetDeviceBytes() const
+{
+	// the uploads by hash, headless ones too, then the textures added
+	// without one, estimated as rgb
+	std::unordered_set<const ur::Texture*> seen;
+	size_t bytes = 0;
+	for (auto& itr : m_hash2tex)
+	{
+		bytes += itr.second.bytes;
+		if (itr.second.tex) {
+			seen.insert(itr.second.tex.get());
+		}
+	}
+	for (auto& itr : m_name2tex)
+	{
+		auto tex = itr.second.get();
+		if (!tex || !seen.insert(tex).second) {
+			continue;
+		}
+		bytes += static_cast<size_t>(tex->GetWidth()) * tex->GetHeight() * 3;
+	}
+	return bytes;
+}
+
+size_t TextureManager::GetHostBytes() const
+{
+	size_t bytes = MemoryBytes::Tree(m_name2tex) + MemoryBytes::Hash(m_hash2tex);
+	for (auto& itr : m_name2tex) {
+		bytes += MemoryBytes::String(itr.first);
+	}
+	bytes += MemoryBytes::Hash(m_sizes);
+	for (auto& itr : m_sizes) {
+		bytes += MemoryBytes::String(itr.first);
+	}
+	return bytes;
+}
+
 }
\ No newline at end of file
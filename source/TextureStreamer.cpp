@@ -0,0 +1,240 @@
+#include "quake/TextureStreamer.h"
+#include "quake/TaskPool.h"
+#include "quake/Palette.h"
+#include "quake/TextureManager.h"
+#include "quake/TextureUploader.h"
+#include "quake/Profiler.h"
+
+#include <chrono>
+#include <algorithm>
+
+namespace
+{
+
+// decoded levels kept ahead of the uploads, few enough that a change of
+// priority is picked up soon
+const size_t MAX_DECODING = 16;
+
+}
+
+namespace quake
+{
+
+TextureStreamer::TextureStreamer(TaskPool& pool, const Palette& palette, MapContext& ctx)
+	: m_pool(pool)
+	, m_palette(palette)
+	, m_ctx(ctx)
+	, m_cancel(false)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	Cancel();
+	WaitAll();
+}
+
+void TextureStreamer::AddWad(TextureUploader& uploader, const unsigned char* data, size_t size)
+{
+	QUAKE_PROFILE_SCOPE("TextureStreamer::AddWad");
+
+	std::vector<WadFileLoader::IndexedTexture> textures;
+	WadFileLoader(m_palette, m_ctx).LoadIndexed(data, size, textures);
+
+	auto& tex_mgr = m_ctx.GetTextures();
+	std::vector<unsigned char> rgb;
+	for (auto& src : textures)
+	{
+		if (m_name2entry.find(src.name) != m_name2entry.end() || tex_mgr.Query(src.name)) {
+			continue;
+		}
+
+		int level = WadFileLoader::MIP_LEVELS - 1;
+		while (level > 0 && (src.mips[level].empty() || (src.width >> level) == 0 || (src.height >> level) == 0)) {
+			--level;
+		}
+		if (src.mips[level].empty()) {
+			continue;
+		}
+
+		const size_t w = src.width >> level, h = src.height >> level;
+		rgb.resize(w * h * 3);
+		m_palette.IndexedToRgb(src.mips[level].data(), w * h, rgb.data());
+		auto tex = uploader.CreateTexture(w, h, ur::TextureFormat::RGB, rgb.data(), rgb.size());
+		tex_mgr.AddPartial(src.name, tex, src.width, src.height);
+
+		QUAKE_PROFILE_COUNTER(Textures, 1);
+		QUAKE_PROFILE_COUNTER(BytesUploaded, rgb.size());
+
+		if (level == 0) {
+			continue;
+		}
+
+		m_entries.emplace_back();
+		auto& dst = m_entries.back();
+		dst.name   = src.name;
+		dst.width  = src.width;
+		dst.height = src.height;
+		dst.level  = level;
+		for (int i = 0; i < level; ++i) {
+			dst.mips[i] = std::move(src.mips[i]);
+		}
+		m_name2entry.insert({ dst.name, m_entries.size() - 1 });
+	}
+
+	SubmitDecodes();
+}
+
+void TextureStreamer::SetPriority(const std::string& name, float priority)
+{
+	auto itr = m_name2entry.find(name);
+	if (itr != m_name2entry.end()) {
+		m_entries[itr->second].priority = priority;
+	}
+}
+
+size_t TextureStreamer::Update(TextureUploader& uploader, double budget_ms)
+{
+	QUAKE_PROFILE_SCOPE("TextureStreamer::Update");
+
+	std::vector<Decoded> decoded;
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		decoded.swap(m_decoded);
+	}
+
+	// priorities may have changed since the decodes were submitted
+	std::sort(decoded.begin(), decoded.end(), [this](const Decoded& a, const Decoded& b) {
+		return m_entries[a.entry].priority > m_entries[b.entry].priority;
+	});
+
+	auto& tex_mgr = m_ctx.GetTextures();
+
+	const auto start = std::chrono::steady_clock::now();
+	const auto budget = std::chrono::duration<double, std::milli>(budget_ms);
+	size_t i = 0;
+	for (size_t n = decoded.size(); i < n && !m_cancel; ++i)
+	{
+		if (i > 0 && std::chrono::steady_clock::now() - start >= budget) {
+			break;
+		}
+
+		auto& d = decoded[i];
+		auto& e = m_entries[d.entry];
+		auto tex = uploader.CreateTexture(e.width >> d.level, e.height >> d.level,
+			ur::TextureFormat::RGB, d.rgb.data(), d.rgb.size());
+		tex_mgr.Upgrade(e.name, tex);
+
+		QUAKE_PROFILE_COUNTER(Textures, 1);
+		QUAKE_PROFILE_COUNTER(BytesUploaded, d.rgb.size());
+
+		e.level    = d.level;
+		e.decoding = false;
+		--m_decoding;
+		for (int j = d.level; j < WadFileLoader::MIP_LEVELS; ++j) {
+			std::vector<unsigned char>().swap(e.mips[j]);
+		}
+	}
+
+	// left for the next frame
+	if (i < decoded.size())
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_decoded.insert(m_decoded.end(), std::make_move_iterator(decoded.begin() + i),
+			std::make_move_iterator(decoded.end()));
+	}
+
+	SubmitDecodes();
+
+	size_t pending = 0;
+	for (auto& e : m_entries) {
+		if (e.level > 0) {
+			++pending;
+		}
+	}
+	return pending;
+}
+
+int TextureStreamer::GetLevel(const std::string& name) const
+{
+	auto itr = m_name2entry.find(name);
+	if (itr != m_name2entry.end()) {
+		return m_entries[itr->second].level;
+	}
+	return m_ctx.GetTextures().Query(name) ? 0 : -1;
+}
+
+void TextureStreamer::Cancel()
+{
+	m_cancel = true;
+}
+
+void TextureStreamer::DecodeTask(const Entry& e, size_t entry, int level)
+{
+	Decoded d;
+	d.entry = entry;
+	d.level = level;
+	if (!m_cancel)
+	{
+		auto& indices = e.mips[level];
+		d.rgb.resize(indices.size() * 3);
+		m_palette.IndexedToRgb(indices.data(), indices.size(), d.rgb.data());
+		QUAKE_PROFILE_COUNTER(BytesDecoded, d.rgb.size());
+	}
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_decoded.push_back(std::move(d));
+}
+
+void TextureStreamer::SubmitDecodes()
+{
+	if (m_cancel || m_decoding >= MAX_DECODING) {
+		return;
+	}
+
+	m_futures.erase(std::remove_if(m_futures.begin(), m_futures.end(), [](const std::future<void>& f) {
+		return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}), m_futures.end());
+
+	// highest priority first, the blurriest of equal ones
+	std::vector<size_t> candidates;
+	for (size_t i = 0, n = m_entries.size(); i < n; ++i) {
+		if (m_entries[i].level > 0 && !m_entries[i].decoding) {
+			candidates.push_back(i);
+		}
+	}
+	const size_t count = std::min(candidates.size(), MAX_DECODING - m_decoding);
+	std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), [this](size_t a, size_t b) {
+		auto& ea = m_entries[a];
+		auto& eb = m_entries[b];
+		return ea.priority != eb.priority ? ea.priority > eb.priority : ea.level > eb.level;
+	});
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		auto& e = m_entries[candidates[i]];
+		e.decoding = true;
+		++m_decoding;
+
+		// levels missing from the wad are skipped, level 0 is always there
+		int level = e.level - 1;
+		while (level > 0 && e.mips[level].empty()) {
+			--level;
+		}
+
+		// AddWad() may grow the deque meanwhile, the task gets the entry itself
+		const Entry* ptr = &e;
+		const size_t entry = candidates[i];
+		m_futures.push_back(m_pool.Submit([this, ptr, entry, level]() { DecodeTask(*ptr, entry, level); }));
+	}
+}
+
+void TextureStreamer::WaitAll()
+{
+	for (auto& f : m_futures) {
+		f.wait();
+	}
+	m_futures.clear();
+}
+
+}
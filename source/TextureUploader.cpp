@@ -0,0 +1,64 @@
+#include "quake/TextureUploader.h"
+
+#include <chrono>
+
+namespace quake
+{
+
+//////////////////////////////////////////////////////////////////////////
+// class TextureUploader
+//////////////////////////////////////////////////////////////////////////
+
+ur::TexturePtr TextureUploader::CreateTexture(size_t width, size_t height, ur::TextureFormat format,
+	                                          const void* pixels, size_t size)
+{
+	auto begin = std::chrono::steady_clock::now();
+	auto tex = OnCreateTexture(width, height, format, pixels, size);
+	auto end = std::chrono::steady_clock::now();
+
+	Record rec;
+	rec.width   = width;
+	rec.height  = height;
+	rec.format  = format;
+	rec.bytes   = size;
+	rec.time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_records.push_back(rec);
+	++m_stats.count;
+	m_stats.bytes   += rec.bytes;
+	m_stats.time_ns += rec.time_ns;
+
+	return tex;
+}
+
+TextureUploader::Stats TextureUploader::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_stats;
+}
+
+std::vector<TextureUploader::Record> TextureUploader::GetRecords() const
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_records;
+}
+
+void TextureUploader::ResetStats()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_stats = Stats();
+	m_records.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// class DeviceTextureUploader
+//////////////////////////////////////////////////////////////////////////
+
+ur::TexturePtr DeviceTextureUploader::OnCreateTexture(size_t width, size_t height,
+	                                                  ur::TextureFormat format, const void* pixels, size_t size)
+{
+	return m_dev.CreateTexture(width, height, format, pixels, size);
+}
+
+}
@@ -1,6 +1,9 @@
 #include "quake/WadFileLoader.h"
 #include "quake/TextureManager.h"
 #include "quake/Palette.h"
+#include "quake/Profiler.h"
+#include "quake/TextureUploader.h"
+#include "quake/TextureDiskCache.h"
 
 #include <bs/ImportStream.h>
 #include <unirender/Device.h>
@@ -43,71 +46,325 @@ namespace WadEntryType
 
 static const int MIP_LEVEL = 4;
 
-}
-
-namespace quake
+struct MipTex
 {
+	std::string name;
+	uint32_t    width;
+	uint32_t    height;
+	const unsigned char* indices;   // mip 0
 
-WadFileLoader::WadFileLoader(const Palette& palette)
-	: m_palette(palette)
+	// raw payload of every level, size 0 when out of the entry
+	const unsigned char* mips[MIP_LEVEL];
+	size_t mip_sizes[MIP_LEVEL];
+};
+
+// FNV-1a over the size and the indices of all levels, seeded with the
+// palette so the same indices under another palette don't collide
+uint64_t HashMipTex(const MipTex& mt, uint64_t palette_hash)
 {
+	uint64_t h = 0xcbf29ce484222325ull ^ palette_hash;
+	auto mix = [&h](const unsigned char* data, size_t size) {
+		for (size_t i = 0; i < size; ++i) {
+			h ^= data[i];
+			h *= 0x100000001b3ull;
+		}
+	};
+
+	const uint32_t size[2] = { mt.width, mt.height };
+	mix(reinterpret_cast<const unsigned char*>(size), sizeof(size));
+	for (int i = 0; i < MIP_LEVEL; ++i) {
+		mix(mt.mips[i], mt.mip_sizes[i]);
+	}
+	return h;
 }
 
-void WadFileLoader::Load(const ur::Device& dev, const std::string& wad_filepath)
+bool ReadMipTexs(const unsigned char* data, size_t size, std::vector<MipTex>& miptexs)
 {
-	std::ifstream fin(wad_filepath, std::ios::binary);
-	if (fin.fail()) {
-		return;
+	if (size < sizeof(WadHeader)) {
+		return false;
 	}
 
 	WadHeader header;
-	fin.read(reinterpret_cast<char*>(&header), sizeof(header));
+	memcpy(&header, data, sizeof(header));
 	if (strncmp(header.magic, "WAD2", 4) != 0) {
-		fin.close();
-		return;
+		return false;
+	}
+	if (header.diroffset < 0 || header.numentries < 0 ||
+		static_cast<size_t>(header.diroffset) + sizeof(WadEntry) * header.numentries > size) {
+		return false;
 	}
 
-	fin.seekg(header.diroffset);
-	WadEntry* entries = new WadEntry[header.numentries];
-	fin.read(reinterpret_cast<char*>(entries), sizeof(WadEntry) * header.numentries);
-
-	char* buf = new char[header.diroffset];
+	std::vector<WadEntry> entries(header.numentries);
+	memcpy(entries.data(), data + header.diroffset, sizeof(WadEntry) * header.numentries);
 
-	auto tex_mgr = TextureManager::Instance()->Instance();
-	for (int i = 0; i < header.numentries; ++i)
+	for (auto& entry : entries)
 	{
-		auto& entry = entries[i];
-		if (entry.type != 'D') {
+		if (entry.type != WadEntryType::MIP) {
 			continue;
 		}
 		assert(entry.size == entry.dsize && entry.cmprs == 0);
+		if (entry.offset < 0 || static_cast<size_t>(entry.offset) + entry.dsize > size) {
+			continue;
+		}
 
-		fin.seekg(entry.offset);
-		fin.read(buf, entry.dsize);
+		auto buf = reinterpret_cast<const char*>(data + entry.offset);
+		bs::ImportStream is(buf, entry.dsize);
 
-		bs::ImportStream is(buf, header.diroffset);
-		std::string name = is.String(NAME_LEN);
-		uint32_t width = is.UInt32();
-		uint32_t height = is.UInt32();
+		MipTex mt;
+		mt.name   = is.String(NAME_LEN);
+		mt.width  = is.UInt32();
+		mt.height = is.UInt32();
 
         size_t offset[MIP_LEVEL];
         for (int i = 0; i < MIP_LEVEL; ++i) {
             offset[i] = is.UInt32();
         }
+		// in 64 bits, a bogus header's size must not wrap past the check
+		const uint64_t area = static_cast<uint64_t>(mt.width) * mt.height;
+		if (area == 0 || offset[0] + area > static_cast<uint64_t>(entry.dsize)) {
+			continue;
+		}
+		mt.indices = data + entry.offset + offset[0];
 
-        const int channels = 3;
-        size_t size = width * height * channels;
-        unsigned char* pixels = new unsigned char[size];
-        m_palette.IndexedToRgb((unsigned char*)buf + offset[0], size, pixels);
-        auto tex = dev.CreateTexture(width, height, ur::TextureFormat::RGB, pixels, width * height * channels);
-        delete[] pixels;
-		TextureManager::Instance()->Add(name, tex);
+		for (int i = 0; i < MIP_LEVEL; ++i)
+		{
+			const size_t mip_size = static_cast<size_t>(mt.width >> i) * (mt.height >> i);
+			if (offset[i] + mip_size <= static_cast<size_t>(entry.dsize)) {
+				mt.mips[i]      = data + entry.offset + offset[i];
+				mt.mip_sizes[i] = mip_size;
+			} else {
+				mt.mips[i]      = nullptr;
+				mt.mip_sizes[i] = 0;
+			}
+		}
+
+		miptexs.push_back(mt);
+	}
+
+	return true;
+}
+
+// the wad's levels through the palette and the compressor, or from the cache
+void CompressMipTex(const MipTex& mt, uint64_t hash, const quake::Palette& palette,
+	                const quake::TextureCompressor::Params& params, const quake::TextureDiskCache* cache,
+	                quake::TextureCompressor::Image& image)
+{
+	if (cache && cache->Load(hash, params, image)) {
+		return;
 	}
 
-	delete[] buf;
-	delete[] entries;
+	image.format = params.format;
+	image.levels.clear();
 
+	std::vector<unsigned char> rgb;
+	const int levels = params.mips ? MIP_LEVEL : 1;
+	for (int i = 0; i < levels && mt.mips[i] && mt.mip_sizes[i] > 0; ++i)
+	{
+		quake::TextureCompressor::Level level;
+		level.width  = mt.width >> i;
+		level.height = mt.height >> i;
+
+		rgb.resize(mt.mip_sizes[i] * 3);
+		palette.IndexedToRgb(mt.mips[i], mt.mip_sizes[i], rgb.data());
+		level.data.resize(quake::TextureCompressor::CompressedSize(params.format, level.width, level.height));
+		quake::TextureCompressor::Compress(rgb.data(), 3, level.width, level.height,
+			params.format, params.quality, level.data.data());
+
+		image.levels.push_back(std::move(level));
+	}
+
+	if (cache) {
+		cache->Store(hash, params, image);
+	}
+}
+
+}
+
+namespace quake
+{
+
+WadFileLoader::WadFileLoader(const Palette& palette, MapContext& ctx)
+	: m_palette(palette)
+	, m_ctx(ctx)
+{
+}
+
+void WadFileLoader::EnableCompression(const TextureCompressor::Params& params, const TextureDiskCache* cache)
+{
+	m_compress        = true;
+	m_compress_params = params;
+	m_disk_cache      = cache;
+}
+
+void WadFileLoader::Load(const ur::Device& dev, const std::string& wad_filepath)
+{
+	std::ifstream fin(wad_filepath, std::ios::binary | std::ios::ate);
+	if (fin.fail()) {
+		return;
+	}
+
+	std::vector<unsigned char> buf(static_cast<size_t>(fin.tellg()));
+	fin.seekg(0, std::ios::beg);
+	fin.read(reinterpret_cast<char*>(buf.data()), buf.size());
 	fin.close();
+
+	Load(dev, buf.data(), buf.size());
+}
+
+void WadFileLoader::Load(const ur::Device& dev, const unsigned char* data, size_t size)
+{
+	DeviceTextureUploader uploader(dev);
+	Load(uploader, data, size);
+}
+
+void WadFileLoader::Load(TextureUploader& uploader, const unsigned char* data, size_t size)
+{
+	ProfileBind bind(&m_ctx.GetProfiler());
+	QUAKE_PROFILE_SCOPE("WadFileLoader::Load");
+
+	std::vector<MipTex> miptexs;
+	ReadMipTexs(data, size, miptexs);
+
+	const uint64_t palette_hash = m_palette.GetHash();
+
+	auto& tex_mgr = m_ctx.GetTextures();
+	for (auto& mt : miptexs)
+	{
+        const int channels = 3;
+
+		const size_t pixel_num = static_cast<size_t>(mt.width) * mt.height;
+
+		size_t bytes = m_compress
+			? TextureCompressor::CompressedSize(m_compress_params.format, mt.width, mt.height)
+			: pixel_num * channels;
+
+		// already uploaded from this or an earlier wad
+		const uint64_t hash = HashMipTex(mt, palette_hash);
+		if (tex_mgr.AddShared(mt.name, hash, bytes)) {
+			continue;
+		}
+
+		// the uploader takes one level, the smaller ones are for the disk cache
+		TextureCompressor::Image image;
+		if (m_compress) {
+			CompressMipTex(mt, hash, m_palette, m_compress_params, m_disk_cache, image);
+		}
+
+		ur::TexturePtr tex;
+		if (!image.levels.empty())
+		{
+			auto& level = image.levels[0];
+
+			QUAKE_PROFILE_SCOPE("TextureUploader::CreateTexture");
+			tex = uploader.CreateTexture(level.width, level.height, TextureCompressor::ToTextureFormat(image.format),
+				level.data.data(), level.data.size());
+		}
+		else
+		{
+			// uncompressed, or the compressor or the cache had no level 0
+			bytes = pixel_num * channels;
+			unsigned char* pixels = new unsigned char[bytes];
+			m_palette.IndexedToRgb(mt.indices, pixel_num, pixels);
+			{
+				QUAKE_PROFILE_SCOPE("TextureUploader::CreateTexture");
+				tex = uploader.CreateTexture(mt.width, mt.height, ur::TextureFormat::RGB, pixels, bytes);
+			}
+			delete[] pixels;
+		}
+		tex_mgr.Add(mt.name, tex, hash, mt.width, mt.height, bytes);
+
+		QUAKE_PROFILE_COUNTER(Textures, 1);
+		QUAKE_PROFILE_COUNTER(BytesUploaded, bytes);
+		QUAKE_PROFILE_COUNTER(Allocations, 1);
+	}
+}
+
+bool WadFileLoader::Decode(const unsigned char* data, size_t size, std::vector<DecodedTexture>& textures,
+	                       const std::atomic<bool>* cancel, const std::function<bool(uint64_t hash)>& need_pixels) const
+{
+	ProfileBind bind(&m_ctx.GetProfiler());
+	QUAKE_PROFILE_SCOPE("WadFileLoader::Decode");
+
+	std::vector<MipTex> miptexs;
+	if (!ReadMipTexs(data, size, miptexs)) {
+		return false;
+	}
+
+	const uint64_t palette_hash = m_palette.GetHash();
+
+	textures.reserve(textures.size() + miptexs.size());
+	for (auto& mt : miptexs)
+	{
+		if (cancel && *cancel) {
+			return false;
+		}
+
+		DecodedTexture tex;
+		tex.name   = mt.name;
+		tex.width  = mt.width;
+		tex.height = mt.height;
+		tex.hash   = HashMipTex(mt, palette_hash);
+		if (!need_pixels || need_pixels(tex.hash))
+		{
+			if (m_compress) {
+				CompressMipTex(mt, tex.hash, m_palette, m_compress_params, m_disk_cache, tex.compressed);
+			}
+			// uncompressed, or the compressor or the cache had no level 0
+			if (tex.compressed.levels.empty())
+			{
+				const size_t pixel_num = static_cast<size_t>(mt.width) * mt.height;
+				tex.rgb.resize(pixel_num * 3);
+				m_palette.IndexedToRgb(mt.indices, pixel_num, tex.rgb.data());
+			}
+
+			QUAKE_PROFILE_COUNTER(Allocations, 1);
+		}
+		textures.push_back(std::move(tex));
+	}
+
+	return true;
+}
+
+bool WadFileLoader::LoadIndexed(const unsigned char* data, size_t size,
+	                            std::vector<IndexedTexture>& textures) const
+{
+	std::vector<MipTex> miptexs;
+	if (!ReadMipTexs(data, size, miptexs)) {
+		return false;
+	}
+
+	textures.reserve(textures.size() + miptexs.size());
+	for (auto& mt : miptexs)
+	{
+		IndexedTexture tex;
+		tex.name   = mt.name;
+		tex.width  = mt.width;
+		tex.height = mt.height;
+		for (int i = 0; i < MIP_LEVEL; ++i) {
+			if (mt.mips[i]) {
+				tex.mips[i].assign(mt.mips[i], mt.mips[i] + mt.mip_sizes[i]);
+			}
+		}
+		textures.push_back(std::move(tex));
+	}
+
+	return true;
+}
+
+bool WadFileLoader::LoadNames(const unsigned char* data, size_t size,
+	                          std::vector<std::string>& names)
+{
+	std::vector<MipTex> miptexs;
+	if (!ReadMipTexs(data, size, miptexs)) {
+		return false;
+	}
+
+	names.reserve(names.size() + miptexs.size());
+	for (auto& mt : miptexs) {
+		names.push_back(mt.name);
+	}
+
+	return true;
 }
 
 std::string WadFileLoader::LoadString(const char* data, int len)